@@ -23,6 +23,7 @@
 #pragma comment(lib, "OleAut32.lib")
 #else
 #include <utime.h>
+#include <fcntl.h>
 static char charbuffer[1024];
 #define MAIN(_c_,_v_) main(int _c_, char** _v_)
 #define U2F(_s_) (toBytes(_s_))
@@ -166,7 +167,13 @@ struct Outputstream: public Ostream {
         position = ftell(this->file);
         return getResult(result == 0);
     };
-    
+
+#ifdef __linux__
+    virtual HRESULT Reserve(UInt64 size) override {
+        return posix_fallocate(fileno(file), 0, (off_t)size) == 0 ? S_OK : S_FALSE;
+    };
+#endif
+
     FILE* file = nullptr;
 };
 
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "sevenzip.h"
+
+using namespace std;
+using namespace sevenzip;
+
+// BatchFileOstream benchmark: tiny files written as by an extraction, Open, Write, Close, SetTime, SetMode
+// usage: exampleB directory [files [threads [pool] [nomode]]]
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        wcout << "usage: exampleB directory [files [threads [pool] [nomode]]]\n";
+        return 1;
+    }
+    int files = argc > 2 ? atoi(argv[2]) : 100000;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    bool uring = true;
+    bool mode = true;
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "pool") == 0)
+            uring = false;
+        else if (strcmp(argv[i], "nomode") == 0)
+            mode = false;
+    }
+    const int dirs = 100;
+    char data[192];
+    for (int i = 0; i < (int)sizeof(data); i++)
+        data[i] = (char)('a' + i % 26);
+
+    auto start = chrono::steady_clock::now();
+    HRESULT hr = S_OK;
+    bool used = false;
+    {
+        BatchFileOstream out(fromBytes(argv[1]), threads, 0, 0, uring);
+        used = out.IsUring();
+        wchar_t name[64];
+        for (int i = 0; i < dirs && hr == S_OK; i++) {
+            swprintf(name, 64, L"d%03d", i);
+            hr = out.Mkdir(name);
+        }
+        for (int i = 0; i < files && hr == S_OK; i++) {
+            swprintf(name, 64, L"d%03d/f%06d.txt", i % dirs, i);
+            hr = out.Open(name);
+            UInt32 processed = 0;
+            if (hr == S_OK)
+                hr = out.Write(data, 64 + i % 128, processed);
+            out.Close();
+            out.SetTime(name, 1000000000 + i);
+            if (mode)
+                out.SetMode(name, 0644);
+        }
+        HRESULT flushed = out.Flush();
+        if (hr == S_OK && flushed != S_OK)
+            wcout << out.GetErrorPath() << ": ";
+        if (hr == S_OK)
+            hr = flushed;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (hr != S_OK) {
+        wcout << getMessage(hr) << "\n";
+        return 1;
+    }
+    wcout << files << " files " << (used ? "io_uring" : "pool") << (mode ? "" : " nomode") << ": "
+          << seconds << " s, " << (int)(files / seconds) << " files/s\n";
+    return 0;
+}
@@ -40,6 +40,14 @@ namespace sevenzip {
         return pimpl->getMethodName(index);
     }
 
+    UInt64 Lib::getMethodId(int index) {
+        return pimpl->getMethodId(index);
+    }
+
+    int Lib::getMethodByName(const wchar_t* name) {
+        return pimpl->getMethodByName(name);
+    }
+
     int Lib::getNumberOfFormats() {
         return pimpl->getNumberOfFormats();
     }
@@ -52,6 +60,14 @@ namespace sevenzip {
         return pimpl->getFormatBySignature(&stream, ext);
     }
 
+    int Lib::getFormatsBySignature(Istream& stream, int* formats, int maxFormats, const wchar_t* ext) {
+        return pimpl->getFormatsBySignature(&stream, formats, maxFormats, ext);
+    }
+
+    int Lib::findEmbeddedArchives(Istream& stream, EmbeddedArchive* archives, int maxArchives, UInt64 maxScanBytes) {
+        return pimpl->findEmbeddedArchives(&stream, archives, maxArchives, maxScanBytes);
+    }
+
     wchar_t* Lib::getFormatName(int index) {
         return pimpl->getFormatName(index);
     }
@@ -78,6 +94,11 @@ namespace sevenzip {
         return pimpl->open(lib.pimpl, &istream, path, password, formatIndex);
     };
 
+    HRESULT Iarchive::open(Lib& lib, Istream& istream,
+           const wchar_t* path, const wchar_t* password, int formatIndex, UInt64 offset) {
+        return pimpl->open(lib.pimpl, &istream, path, password, formatIndex, offset);
+    };
+
     void Iarchive::close() {
         return pimpl->close();
     };
@@ -90,6 +111,54 @@ namespace sevenzip {
         return pimpl->extract(&ostream, password, itemIndex);
     };
 
+    HRESULT Iarchive::extract(Ostream& ostream, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(&ostream, nullptr, indices, count);
+    };
+
+    HRESULT Iarchive::extract(Ostream& ostream, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(&ostream, password, indices, count);
+    };
+
+    HRESULT Iarchive::extract(Ostream& ostream, Iselector& selector) {
+        return pimpl->extract(&ostream, nullptr, &selector);
+    };
+
+    HRESULT Iarchive::extract(Ostream& ostream, const wchar_t* password, Iselector& selector) {
+        return pimpl->extract(&ostream, password, &selector);
+    };
+
+    HRESULT Iarchive::extract(Ostream* const* ostreams, int numThreads, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(ostreams, numThreads, nullptr, indices, count);
+    };
+
+    HRESULT Iarchive::extract(Ostream* const* ostreams, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(ostreams, numThreads, password, indices, count);
+    };
+
+    HRESULT Iarchive::extract(OstreamFactory& factory, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(&factory, 1, nullptr, indices, count);
+    };
+
+    HRESULT Iarchive::extract(OstreamFactory& factory, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(&factory, 1, password, indices, count);
+    };
+
+    HRESULT Iarchive::extract(OstreamFactory& factory, int numThreads, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(&factory, numThreads, nullptr, indices, count);
+    };
+
+    HRESULT Iarchive::extract(OstreamFactory& factory, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        return pimpl->extract(&factory, numThreads, password, indices, count);
+    };
+
+    HRESULT Iarchive::openItem(int index, Istream*& istream, UInt32 bufferSize) {
+        return pimpl->openItem(index, nullptr, istream, bufferSize);
+    };
+
+    HRESULT Iarchive::openItem(int index, const wchar_t* password, Istream*& istream, UInt32 bufferSize) {
+        return pimpl->openItem(index, password, istream, bufferSize);
+    };
+
     int Iarchive::getNumberOfItems() {
         return pimpl->getNumberOfItems();
     };
@@ -118,6 +187,76 @@ namespace sevenzip {
         return pimpl->getItemIsDir(index);
     };
 
+    HRESULT Iarchive::snapshot() {
+        return pimpl->snapshot();
+    };
+
+    HRESULT Iarchive::getItemInfo(int index, ItemInfo& info) {
+        return pimpl->getItemInfo(index, info);
+    };
+
+    int Iarchive::getNumberOfBlocks() {
+        return pimpl->getNumberOfBlocks();
+    };
+
+    HRESULT Iarchive::getBlockInfo(int blockIndex, BlockInfo& info) {
+        return pimpl->getBlockInfo(blockIndex, info);
+    };
+
+    HRESULT Iarchive::planExtract(const UInt32* indices, UInt32 count, ExtractPlan& plan,
+            BlockPlan* blocks, UInt32 maxBlocks) {
+        return pimpl->planExtract(indices, count, plan, blocks, maxBlocks);
+    };
+
+    HRESULT Iarchive::findChanged(Ostream& ostream, const UInt32* indices, UInt32 count,
+            UInt32* changed, UInt32& numChanged) {
+        return pimpl->findChanged(&ostream, indices, count, changed, numChanged);
+    };
+
+    void Iarchive::setReadAhead(UInt32 numBlocks, UInt32 blockSize) {
+        pimpl->setReadAhead(numBlocks, blockSize);
+    };
+
+    void Iarchive::setWriteBehind(UInt32 numBuffers, UInt32 bufferSize) {
+        pimpl->setWriteBehind(numBuffers, bufferSize);
+    };
+
+    void Iarchive::setDeferredMetadata(int numThreads) {
+        pimpl->setDeferredMetadata(numThreads);
+    };
+
+    void Iarchive::setSkipUnchanged(int mode, int numThreads) {
+        pimpl->setSkipUnchanged(mode, numThreads);
+    };
+
+    HRESULT Iarchive::setStringProperty(const wchar_t* name, const wchar_t* value) {
+        return pimpl->setStringProperty(name, value);
+    };
+
+    HRESULT Iarchive::setBoolProperty(const wchar_t* name, bool value) {
+        return pimpl->setBoolProperty(name, value);
+    };
+
+    HRESULT Iarchive::setIntProperty(const wchar_t* name, UInt32 value) {
+        return pimpl->setIntProperty(name, value);
+    };
+
+    HRESULT Iarchive::setWideProperty(const wchar_t* name, UInt64 value) {
+        return pimpl->setWideProperty(name, value);
+    };
+
+    HRESULT Iarchive::setEmptyProperty(const wchar_t* name) {
+        return pimpl->setEmptyProperty(name);
+    };
+
+    void Iarchive::getStats(Stats& stats) {
+        pimpl->getStats(stats);
+    };
+
+    void Iarchive::resetStats() {
+        pimpl->resetStats();
+    };
+
     int Iarchive::getNumberOfProperties() {
         return pimpl->getNumberOfProperties();
     };
@@ -199,6 +338,14 @@ namespace sevenzip {
     HRESULT Oarchive::update() {
         return pimpl->update();
     };
+
+    void Oarchive::getStats(Stats& stats) {
+        pimpl->getStats(stats);
+    };
+
+    void Oarchive::resetStats() {
+        pimpl->resetStats();
+    };
     
     HRESULT Oarchive::setStringProperty(const wchar_t* name, const wchar_t* value) {
         return pimpl->setStringProperty(name, value);
@@ -219,4 +366,81 @@ namespace sevenzip {
     HRESULT Oarchive::setEmptyProperty(const wchar_t* name) {
         return pimpl->setEmptyProperty(name);
     };
+
+    Codec::Codec(): pimpl(new Impl()) {};
+
+    Codec::~Codec() {delete pimpl;};
+
+    HRESULT Codec::open(Lib& lib, const wchar_t* method) {
+        return pimpl->open(lib.pimpl, method);
+    };
+
+    void Codec::close() {
+        pimpl->close();
+    };
+
+    HRESULT Codec::setLevel(UInt32 level) {
+        return pimpl->setLevel(level);
+    };
+
+    HRESULT Codec::setDictionarySize(UInt32 dictionarySize) {
+        return pimpl->setDictionarySize(dictionarySize);
+    };
+
+    HRESULT Codec::setNumberOfThreads(UInt32 numThreads) {
+        return pimpl->setNumberOfThreads(numThreads);
+    };
+
+    HRESULT Codec::getEncoderProperties(void* data, UInt32 size, UInt32& processed) {
+        return pimpl->getEncoderProperties(data, size, processed);
+    };
+
+    HRESULT Codec::setDecoderProperties(const void* data, UInt32 size) {
+        return pimpl->setDecoderProperties(data, size);
+    };
+
+    HRESULT Codec::encode(Istream& istream, Ostream& ostream, UInt64 inSize) {
+        return pimpl->encode(&istream, &ostream, inSize);
+    };
+
+    HRESULT Codec::decode(Istream& istream, Ostream& ostream, UInt64 outSize) {
+        return pimpl->decode(&istream, &ostream, outSize);
+    };
+
+    HRESULT Codec::encode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed) {
+        return pimpl->encode(in, inSize, out, outSize, processed);
+    };
+
+    HRESULT Codec::decode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed) {
+        return pimpl->decode(in, inSize, out, outSize, processed);
+    };
+
+    CodecPool::CodecPool(): pimpl(new Impl()) {};
+
+    CodecPool::~CodecPool() {delete pimpl;};
+
+    HRESULT CodecPool::open(Lib& lib, UInt32 maxIdle) {
+        return pimpl->open(lib.pimpl, maxIdle);
+    };
+
+    void CodecPool::close() {
+        pimpl->close();
+    };
+
+    HRESULT CodecPool::acquire(const wchar_t* method, Codec*& codec,
+            UInt32 level, UInt32 dictionarySize, UInt32 numThreads) {
+        return pimpl->acquire(method, codec, level, dictionarySize, numThreads);
+    };
+
+    void CodecPool::release(Codec* codec) {
+        pimpl->release(codec);
+    };
+
+    void CodecPool::getStats(PoolStats& stats) {
+        pimpl->getStats(stats);
+    };
+
+    void CodecPool::resetStats() {
+        pimpl->resetStats();
+    };
 }
@@ -33,6 +33,24 @@ namespace sevenzip {
 
     const unsigned Version = ((LIBSEVENZIP_VER_MAJOR << 16) | LIBSEVENZIP_VER_MINOR);
 
+    // Access pattern hints for the Istream Advise method
+
+    enum Advice {
+        ADVICE_NORMAL,
+        ADVICE_SEQUENTIAL,
+        ADVICE_RANDOM,
+        ADVICE_WILLNEED,
+        ADVICE_DONTNEED
+    };
+
+    // Unchanged items check for the Iarchive setSkipUnchanged method
+
+    enum SkipMode {
+        SKIP_NONE,
+        SKIP_SIZE_TIME,
+        SKIP_CRC
+    };
+
     // To be redefined by the user of the library
 
     // Input stream interface
@@ -62,6 +80,14 @@ namespace sevenzip {
 
         // Used by open multivolume handler
         virtual Istream* Clone() const { return nullptr; };
+
+        // Optional positional read, should not change the stream position
+        // Should be safe to call concurrently, the parallel extraction shares the stream then
+        virtual HRESULT ReadAt(UInt64 /*offset*/, void* /*data*/, UInt32 /*size*/, UInt32& /*processed*/) { return E_NOTIMPL; };
+
+        // Optional access pattern hint for the range, size 0 is up to the end of the stream
+        // Called when the archive reads become sequential or random, and for the ranges ahead and behind
+        virtual HRESULT Advise(UInt64 /*offset*/, UInt64 /*size*/, int /*advice*/) { return E_NOTIMPL; };
         
         virtual ~Istream() = default;
     };
@@ -84,13 +110,129 @@ namespace sevenzip {
         virtual HRESULT SetSize(UInt64 /*size*/) { return S_FALSE; };
 
         // Used by extract handler
+        // Reserve is called after Open with the item size before any Write, can preallocate the file
+        virtual HRESULT Reserve(UInt64 /*size*/) { return S_FALSE; };
         virtual HRESULT Mkdir(const wchar_t* /*dirname*/) { return S_FALSE; };
         virtual HRESULT SetMode(const wchar_t* /*path*/, UInt32 /*mode*/) { return S_FALSE; };
         virtual HRESULT SetAttr(const wchar_t* /*filename*/, UInt32 /*attr*/) { return S_FALSE; };
         virtual HRESULT SetTime(const wchar_t* /*filename*/, UInt32 /*time*/) { return S_FALSE; };
 
+        // Optional check of the existing destination, used by the skip-if-unchanged extraction
+        // Stat should return S_FALSE when the file does not exist, both should be safe to call concurrently
+        virtual HRESULT Stat(const wchar_t* /*filename*/, UInt64& /*size*/, UInt32& /*time*/) { return E_NOTIMPL; };
+        virtual HRESULT GetCrc(const wchar_t* /*filename*/, UInt32& /*crc*/) { return E_NOTIMPL; };
+
+        // Optional copy of the istream range to the opened file after Open, e.g. with copy_file_range
+        // Used for the stored items, size 0 checks the support; E_NOTIMPL or an error makes the library write the data
+        virtual HRESULT WriteFrom(Istream& /*istream*/, UInt64 /*offset*/, UInt64 /*size*/, UInt64& /*processed*/) { return E_NOTIMPL; };
+
         virtual ~Ostream() = default;
     };
+
+    // Archive item description
+    // Filled from the Iarchive snapshot, path points to the snapshot storage
+    // and stays valid until the next snapshot or close call
+
+    struct ItemInfo {
+        const wchar_t* path;
+        UInt32 pathLength;
+        UInt64 size;
+        UInt64 packSize;
+        UInt32 time;
+        UInt32 attr;
+        UInt32 mode;
+        UInt32 crc;
+        UInt32 block;
+        bool isDir;
+        bool hasCrc;
+        bool hasBlock;
+    };
+
+    // Output stream factory interface
+    // Used to create a separate output stream for every extracted item in the Iarchive class
+    // Create can return nullptr to skip the item, Release is called when the item is done
+
+    struct OstreamFactory {
+
+        virtual Ostream* Create(int /*index*/, const ItemInfo& /*info*/) = 0;
+        virtual void Release(int /*index*/, Ostream* /*ostream*/, HRESULT /*result*/) {};
+
+        virtual ~OstreamFactory() = default;
+    };
+
+    // Solid block description
+    // Filled from the Iarchive block map, method points to the block map storage
+    // and stays valid until the next snapshot or close call
+
+    struct BlockInfo {
+        UInt32 block;
+        UInt32 numItems;
+        UInt64 size;
+        UInt64 packSize;
+        const wchar_t* method;
+    };
+
+    // Extraction plan of a block
+    // block is the block map index or -1 for all the requested items stored out of blocks
+    // cost is the estimated number of bytes read and decoded
+
+    struct BlockPlan {
+        UInt32 block;
+        UInt32 numItems;
+        UInt64 wantedSize;
+        UInt64 decodeSize;
+        UInt64 wastedSize;
+        UInt64 cost;
+    };
+
+    // Extraction plan totals
+
+    struct ExtractPlan {
+        UInt32 numBlocks;
+        UInt64 wantedSize;
+        UInt64 decodeSize;
+        UInt64 wastedSize;
+        UInt64 cost;
+    };
+
+    // Embedded archive candidate
+    // Filled by the Lib::findEmbeddedArchives, offset is the archive start in the stream
+
+    struct EmbeddedArchive {
+        UInt64 offset;
+        int formatIndex;
+    };
+
+    // Stream statistics
+    // Collected by the stream wrappers of the Iarchive and Oarchive classes,
+    // seeksElided are the seeks answered without calling the user stream,
+    // readAhead* are the reads served from the read-ahead blocks or read directly
+
+    struct Stats {
+        UInt64 reads;
+        UInt64 readBytes;
+        UInt64 writes;
+        UInt64 writeBytes;
+        UInt64 seeks;
+        UInt64 seeksElided;
+        UInt64 readAheadHits;
+        UInt64 readAheadMisses;
+        UInt64 skips;
+        UInt64 skipBytes;
+        UInt64 copies;
+        UInt64 copyBytes;
+        UInt64 threads;
+    };
+
+    // Item selection interface
+    // Used to select items to extract in the Iarchive class
+
+    struct Iselector {
+
+        virtual bool Select(int index) = 0;
+
+        virtual ~Iselector() = default;
+    };
 };
 
 namespace sevenzip {
@@ -112,6 +254,8 @@ namespace sevenzip {
 
         int getNumberOfMethods();
         wchar_t* getMethodName(int index);
+        UInt64 getMethodId(int index); // 7-Zip method ID, e.g. 0x21 for LZMA2
+        int getMethodByName(const wchar_t* name);
 
         int getNumberOfFormats();
         wchar_t* getFormatName(int index);
@@ -119,6 +263,10 @@ namespace sevenzip {
         bool getFormatUpdatable(int index);
         int getFormatByExtension(const wchar_t* ext);
         int getFormatBySignature(Istream& stream, const wchar_t* ext = nullptr);
+        int getFormatsBySignature(Istream& stream, int* formats, int maxFormats, const wchar_t* ext = nullptr);
+
+        // maxScanBytes == 0 : scan the whole stream
+        int findEmbeddedArchives(Istream& stream, EmbeddedArchive* archives, int maxArchives, UInt64 maxScanBytes = 0);
 
     private:
 
@@ -126,6 +274,8 @@ namespace sevenzip {
         Impl* pimpl;
         friend class Iarchive;
         friend class Oarchive;
+        friend class Codec;
+        friend class CodecPool;
     };
 
     // Archive reading/extracting class
@@ -149,13 +299,87 @@ namespace sevenzip {
         HRESULT open(Lib& lib, Istream& istream,
                 const wchar_t* filename, const wchar_t* password, int formatIndex = -1);
 
+        // opens an archive starting at the offset, e.g. found by Lib::findEmbeddedArchives
+        // stream positions seen by the handler are relative to the offset
+
+        HRESULT open(Lib& lib, Istream& istream,
+                const wchar_t* filename, const wchar_t* password, int formatIndex, UInt64 offset);
+
         void close();
 
+        // read-ahead of the archive stream on a background thread, applied by the next open
+        // numBlocks == 0 : disabled (default)
+        // blockSize == 0 : default block size (1 MiB)
+
+        void setReadAhead(UInt32 numBlocks, UInt32 blockSize = 0);
+
+        // write-behind of the extracted data on a background thread, used by the next extract
+        // numBuffers == 0 : disabled (default), the decoder waits when all buffers are queued
+        // bufferSize == 0 : default buffer size (1 MiB)
+        // write errors are returned by the extract for the item being written
+
+        void setWriteBehind(UInt32 numBuffers, UInt32 bufferSize = 0);
+
+        // deferred metadata of the extracted items, used by the next extract to an Ostream
+        // numThreads == 0 : disabled (default), the metadata of every item is set when it is extracted
+        // numThreads > 0 : the time, attributes and mode are taken from the snapshot and set when all items
+        // are extracted, files by numThreads threads, then directories deepest first;
+        // with numThreads > 1 the SetTime/SetAttr/SetMode methods of the Ostream are called concurrently
+
+        void setDeferredMetadata(int numThreads);
+
+        // skip-if-unchanged extraction, used by the next extract to an Ostream
+        // mode == SKIP_NONE : all items are extracted (default)
+        // mode == SKIP_SIZE_TIME : files with the size and time of the existing destination are not extracted
+        // mode == SKIP_CRC : also the CRC of the destination is compared when the item has one
+        // numThreads == 0 : the destinations are checked by getNumberOfThreads() threads
+        // unchanged items are dropped before the handler is called, solid blocks with no changed items are not decoded
+
+        void setSkipUnchanged(int mode, int numThreads = 0);
+
+        // decoder properties, e.g. mt or memuse, set on the handlers created by the next open
+        // the nested handlers and the parallel workers included, a property set again replaces the value
+
+        HRESULT setStringProperty(const wchar_t* name, const wchar_t* value);
+        HRESULT setBoolProperty(const wchar_t* name, bool value);
+        HRESULT setIntProperty(const wchar_t* name, UInt32 value);
+        HRESULT setWideProperty(const wchar_t* name, UInt64 value);
+        HRESULT setEmptyProperty(const wchar_t* name);
+
         // ostream can be preopened in the case of single item extraction (index > -1)
 
         HRESULT extract(Ostream& ostream, int index = -1);
         HRESULT extract(Ostream& ostream, const wchar_t* password, int index = -1);
 
+        // indices can be unsorted and duplicated, selected items are extracted in a single pass
+
+        HRESULT extract(Ostream& ostream, const UInt32* indices, UInt32 count);
+        HRESULT extract(Ostream& ostream, const wchar_t* password, const UInt32* indices, UInt32 count);
+        HRESULT extract(Ostream& ostream, Iselector& selector);
+        HRESULT extract(Ostream& ostream, const wchar_t* password, Iselector& selector);
+
+        // parallel extraction, ostreams[i] is used by the worker i only
+        // istream Clone or ReadAt is required, solid archives with several blocks are split by the blocks,
+        // single-block solid archives and subarchives are extracted sequentially to ostreams[0]
+
+        HRESULT extract(Ostream* const* ostreams, int numThreads, const UInt32* indices, UInt32 count);
+        HRESULT extract(Ostream* const* ostreams, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count);
+
+        // per item output streams, factory is called from the worker threads in the parallel mode
+
+        HRESULT extract(OstreamFactory& factory, const UInt32* indices, UInt32 count);
+        HRESULT extract(OstreamFactory& factory, const wchar_t* password, const UInt32* indices, UInt32 count);
+        HRESULT extract(OstreamFactory& factory, int numThreads, const UInt32* indices, UInt32 count);
+        HRESULT extract(OstreamFactory& factory, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count);
+
+        // pull-model reader of a single item, the stream is deleted by the caller
+        // the handler stream is returned when the handler supports it, seekable for the stored items of some formats,
+        // otherwise the item is decoded by a background thread into a buffer of bufferSize bytes (0 for 1 MiB);
+        // the archive should not be used or closed until the stream is deleted
+
+        HRESULT openItem(int index, Istream*& istream, UInt32 bufferSize = 0);
+        HRESULT openItem(int index, const wchar_t* password, Istream*& istream, UInt32 bufferSize = 0);
+
         // archive items listing
 
         int getNumberOfItems();
@@ -166,6 +390,30 @@ namespace sevenzip {
         UInt32 getItemTime(int index);
         bool getItemIsDir(int index);
 
+        // archive items metadata snapshot, getItem* methods use it when taken
+
+        HRESULT snapshot();
+        HRESULT getItemInfo(int index, ItemInfo& info);
+
+        // solid blocks map and extraction planner, built from the snapshot
+        // blocks are the first maxBlocks block plans, plan.numBlocks is the total number
+
+        int getNumberOfBlocks();
+        HRESULT getBlockInfo(int blockIndex, BlockInfo& info);
+        HRESULT planExtract(const UInt32* indices, UInt32 count, ExtractPlan& plan,
+                BlockPlan* blocks = nullptr, UInt32 maxBlocks = 0);
+
+        // changed items of the indices checked against the ostream destination as set by setSkipUnchanged
+        // changed has room for count indices, the result is sorted and can be passed to planExtract
+
+        HRESULT findChanged(Ostream& ostream, const UInt32* indices, UInt32 count,
+                UInt32* changed, UInt32& numChanged);
+
+        // stream statistics, accumulated since open or the last reset, workers included
+
+        void getStats(Stats& stats);
+        void resetStats();
+
         // lowlevel routines, CPP/7zip/PropID.h and CPP/Common/MyWindows.h can be useful
 
         int getNumberOfProperties();
@@ -212,6 +460,11 @@ namespace sevenzip {
 
         HRESULT update();
 
+        // stream statistics, accumulated since open or the last reset
+
+        void getStats(Stats& stats);
+        void resetStats();
+
         HRESULT setStringProperty(const wchar_t* name, const wchar_t* value);
         HRESULT setBoolProperty(const wchar_t* name, bool value);
         HRESULT setIntProperty(const wchar_t* name, UInt32 value);
@@ -224,10 +477,298 @@ namespace sevenzip {
         Impl* pimpl;
     };
 
+    // Raw stream coder of one method, e.g. LZMA, LZMA2, Deflate or Zstd, without an archive container
+    // The encoder and the decoder are created by the first call and reused by the next ones
+
+    class Codec {
+
+    public:
+
+        Codec();
+        ~Codec();
+
+        // method is a name of Lib::getMethodName, case insensitive
+
+        HRESULT open(Lib& lib, const wchar_t* method);
+        void close();
+
+        // encoder properties, set by the next encode
+        // level == 0 .. 9, dictionarySize in bytes
+        // numThreads == 0 : getNumberOfThreads(), used by the decoder too when it is multithreaded
+
+        HRESULT setLevel(UInt32 level);
+        HRESULT setDictionarySize(UInt32 dictionarySize);
+        HRESULT setNumberOfThreads(UInt32 numThreads);
+
+        // properties written by the encoder and needed by the decoder, e.g. 5 bytes of LZMA, 1 byte of LZMA2
+        // processed == 0 : the method has no properties
+
+        HRESULT getEncoderProperties(void* data, UInt32 size, UInt32& processed);
+        HRESULT setDecoderProperties(const void* data, UInt32 size);
+
+        // streams must be opened, the data is read from and written at the current positions
+        // inSize/outSize == (UInt64)-1 : up to the end of the input
+        // decoding of LZMA without the end marker needs outSize
+
+        HRESULT encode(Istream& istream, Ostream& ostream, UInt64 inSize = (UInt64)(Int64)-1);
+        HRESULT decode(Istream& istream, Ostream& ostream, UInt64 outSize = (UInt64)(Int64)-1);
+
+        // one-shot buffer calls, E_OUTOFMEMORY if the output does not fit in outSize
+
+        HRESULT encode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed);
+        HRESULT decode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed);
+
+    private:
+
+        class Impl;
+        Impl* pimpl;
+        friend class CodecPool;
+    };
+
+    // Codec pool statistics
+
+    struct PoolStats {
+        UInt64 hits;    // codecs taken from the pool
+        UInt64 misses;  // codecs created
+        UInt64 idle;    // codecs kept in the pool
+    };
+
+    // Thread safe pool of codecs keyed by the method and the encoder properties
+    // A released codec keeps its encoder and decoder, the next acquire of the same key reuses them
+    // instead of allocating the dictionaries and the match finder tables again
+    // A codec is used by one thread between acquire and release
+
+    class CodecPool {
+
+    public:
+
+        CodecPool();
+        ~CodecPool();
+
+        // maxIdle == 0 : up to getNumberOfThreads() codecs of every key are kept
+
+        HRESULT open(Lib& lib, UInt32 maxIdle = 0);
+        void close();
+
+        // level, dictionarySize and numThreads as of Codec, (UInt32)-1 and 0 : defaults
+        // the codec is kept under its method and properties at the release, the decoder properties are dropped;
+        // codecs over maxIdle and codecs released after close are deleted
+
+        HRESULT acquire(const wchar_t* method, Codec*& codec,
+                UInt32 level = (UInt32)(Int32)-1, UInt32 dictionarySize = 0, UInt32 numThreads = 0);
+        void release(Codec* codec);
+
+        void getStats(PoolStats& stats);
+        void resetStats();
+
+    private:
+
+        class Impl;
+        Impl* pimpl;
+    };
+
+    // File input stream
+    // Reads with positional reads through a block buffer, reads larger than the block go directly
+    // Clone shares the file descriptor, Open of the same file reuses it
+    // Get* methods use one cached stat per pathname
+
+    class FileIstream: public Istream {
+
+    public:
+
+        FileIstream(UInt32 blockSize = 0);
+        virtual ~FileIstream();
+
+        virtual HRESULT Open(const wchar_t* filename) override;
+        virtual void Close() override;
+        virtual HRESULT Read(void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Seek(Int64 offset, UInt32 origin, UInt64& position) override;
+        virtual UInt64 GetSize(const wchar_t* filename) override;
+        virtual bool IsDir(const wchar_t* filename) override;
+        virtual UInt32 GetMode(const wchar_t* filename) override;
+        virtual UInt32 GetAttr(const wchar_t* filename) override;
+        virtual UInt32 GetTime(const wchar_t* filename) override;
+        virtual Istream* Clone() const override;
+        virtual HRESULT ReadAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Advise(UInt64 offset, UInt64 size, int advice) override;
+
+    private:
+
+        FileIstream(const FileIstream&) = delete;
+        FileIstream& operator=(const FileIstream&) = delete;
+
+        friend struct CFileSource;
+
+        class Impl;
+        Impl* pimpl;
+    };
+
+    // Memory mapped file input stream
+    // Reads are copied from the mapping, the files that cannot be mapped are read with positional reads
+    // Clone shares the mapping, Advise is passed to madvise
+
+    class MmapIstream: public Istream {
+
+    public:
+
+        MmapIstream();
+        virtual ~MmapIstream();
+
+        virtual HRESULT Open(const wchar_t* filename) override;
+        virtual void Close() override;
+        virtual HRESULT Read(void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Seek(Int64 offset, UInt32 origin, UInt64& position) override;
+        virtual UInt64 GetSize(const wchar_t* filename) override;
+        virtual bool IsDir(const wchar_t* filename) override;
+        virtual UInt32 GetMode(const wchar_t* filename) override;
+        virtual UInt32 GetAttr(const wchar_t* filename) override;
+        virtual UInt32 GetTime(const wchar_t* filename) override;
+        virtual Istream* Clone() const override;
+        virtual HRESULT ReadAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Advise(UInt64 offset, UInt64 size, int advice) override;
+
+        // true if the file is mapped, false if it is read with positional reads
+        bool IsMapped() const;
+
+    private:
+
+        MmapIstream(const MmapIstream&) = delete;
+        MmapIstream& operator=(const MmapIstream&) = delete;
+
+        friend struct CFileSource;
+
+        class Impl;
+        Impl* pimpl;
+    };
+
+    // File output stream
+    // Writes with positional writes, pathnames are relative to the base directory if given,
+    // missing parent directories are created
+
+    class FileOstream: public Ostream {
+
+    public:
+
+        FileOstream(const wchar_t* basepath = nullptr);
+        virtual ~FileOstream();
+
+        virtual HRESULT Open(const wchar_t* filename) override;
+        virtual void Close() override;
+        virtual HRESULT Write(const void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Seek(Int64 offset, UInt32 origin, UInt64& position) override;
+        virtual HRESULT SetSize(UInt64 size) override;
+        virtual HRESULT Reserve(UInt64 size) override;
+        virtual HRESULT Mkdir(const wchar_t* dirname) override;
+        virtual HRESULT SetMode(const wchar_t* path, UInt32 mode) override;
+        virtual HRESULT SetAttr(const wchar_t* filename, UInt32 attr) override;
+        virtual HRESULT SetTime(const wchar_t* filename, UInt32 time) override;
+        virtual HRESULT Stat(const wchar_t* filename, UInt64& size, UInt32& time) override;
+        virtual HRESULT GetCrc(const wchar_t* filename, UInt32& crc) override;
+        virtual HRESULT WriteFrom(Istream& istream, UInt64 offset, UInt64 size, UInt64& processed) override;
+
+    private:
+
+        FileOstream(const FileOstream&) = delete;
+        FileOstream& operator=(const FileOstream&) = delete;
+
+        class Impl;
+        Impl* pimpl;
+    };
+
+    // Directory output stream
+    // Same as FileOstream, but the files and directories are created relative to the handle of the base
+    // directory with openat and mkdirat; the parent directory handles are cached, so every directory
+    // is looked up and created once
+
+    class DirectoryOstream: public Ostream {
+
+    public:
+
+        DirectoryOstream(const wchar_t* basepath = nullptr);
+        virtual ~DirectoryOstream();
+
+        virtual HRESULT Open(const wchar_t* filename) override;
+        virtual void Close() override;
+        virtual HRESULT Write(const void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Seek(Int64 offset, UInt32 origin, UInt64& position) override;
+        virtual HRESULT SetSize(UInt64 size) override;
+        virtual HRESULT Reserve(UInt64 size) override;
+        virtual HRESULT Mkdir(const wchar_t* dirname) override;
+        virtual HRESULT SetMode(const wchar_t* path, UInt32 mode) override;
+        virtual HRESULT SetAttr(const wchar_t* filename, UInt32 attr) override;
+        virtual HRESULT SetTime(const wchar_t* filename, UInt32 time) override;
+        virtual HRESULT Stat(const wchar_t* filename, UInt64& size, UInt32& time) override;
+        virtual HRESULT GetCrc(const wchar_t* filename, UInt32& crc) override;
+        virtual HRESULT WriteFrom(Istream& istream, UInt64 offset, UInt64 size, UInt64& processed) override;
+
+    private:
+
+        DirectoryOstream(const DirectoryOstream&) = delete;
+        DirectoryOstream& operator=(const DirectoryOstream&) = delete;
+
+        class Impl;
+        Impl* pimpl;
+    };
+
+    // Batched file output stream for extracting many small files
+    // Items up to itemSizeMax bytes are kept in memory and written with their time and mode by a pool
+    // of numThreads threads, larger items are written directly and closed by the pool;
+    // at most queueDepth items wait for the pool, zero arguments select the defaults
+    // ioUring == true : on Linux 5.17 and later the pool is replaced by one thread submitting the items
+    // to io_uring as linked openat, write and close, queueDepth items at once (default)
+    // Pathnames are relative to the base directory if given, missing parent directories are created
+    // Flush must be called after extraction: the write errors of the queued items are returned by Flush only,
+    // not by the calls of the other items, with the failed item given by GetErrorPath; the destructor waits
+    // for the items but the errors not flushed are lost
+
+    class BatchFileOstream: public Ostream {
+
+    public:
+
+        BatchFileOstream(const wchar_t* basepath = nullptr, int numThreads = 0, UInt32 queueDepth = 0, UInt32 itemSizeMax = 0,
+                bool ioUring = true);
+        virtual ~BatchFileOstream();
+
+        virtual HRESULT Open(const wchar_t* filename) override;
+        virtual void Close() override;
+        virtual HRESULT Write(const void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Reserve(UInt64 size) override;
+        virtual HRESULT Mkdir(const wchar_t* dirname) override;
+        virtual HRESULT SetMode(const wchar_t* path, UInt32 mode) override;
+        virtual HRESULT SetAttr(const wchar_t* filename, UInt32 attr) override;
+        virtual HRESULT SetTime(const wchar_t* filename, UInt32 time) override;
+        virtual HRESULT Stat(const wchar_t* filename, UInt64& size, UInt32& time) override;
+        virtual HRESULT GetCrc(const wchar_t* filename, UInt32& crc) override;
+
+        // Waits for the queued items, returns the first error since the last Flush
+        HRESULT Flush();
+
+        // Full pathname of the item that failed with the error returned by the last Flush, empty if none
+        const wchar_t* GetErrorPath() const;
+
+        // Items are written through io_uring, false if not requested or not supported by the kernel
+        bool IsUring() const;
+
+    private:
+
+        BatchFileOstream(const BatchFileOstream&) = delete;
+        BatchFileOstream& operator=(const BatchFileOstream&) = delete;
+
+        class Impl;
+        Impl* pimpl;
+    };
+
     wchar_t* getMessage(HRESULT hr);
     HRESULT getResult(bool noerror);
     UInt32 getVersion();
 
+    // number of threads used by the library, the mt property of the handlers when it is not set
+    // detected from the processor affinity and the cgroup CPU quota unless set for the process
+    // numThreads == 0 : detected (default)
+
+    int getNumberOfThreads();
+    void setNumberOfThreads(int numThreads);
+
     wchar_t *fromBytes(const char* str); // static buffer 1024 wchar_ts
     wchar_t *fromBytes(wchar_t* buffer, size_t size, const char* str);
 
@@ -0,0 +1,2106 @@
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "CPP/Common/MyWindows.h"
+
+#include "sevenzip_impl.h"
+
+#include "CPP/Common/StringConvert.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+#include <stdio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <stdlib.h>
+#include <string.h>
+// NOTE: direct descriptors of openat and close, kernel 5.17 headers and later
+#if defined(IORING_FEAT_CQE_SKIP) && defined(__NR_io_uring_setup)
+#define SEVENZIP_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef DEBUG_IMPL
+#   include <iostream>
+#   define DEBUGLOG(_x_) (std::wcerr << "DEBUG: " << _x_ << "\n")
+#else
+#   define DEBUGLOG(_x_)
+#endif
+
+#ifndef min
+#define min(_a_,_b_) (((_a_) < (_b_)) ? (_a_) : (_b_))
+#endif
+#ifndef max
+#define max(_a_,_b_) (((_a_) > (_b_)) ? (_a_) : (_b_))
+#endif
+
+namespace sevenzip {
+
+    static const UInt32 kFileBlockSize = (UInt32)1 << 18;
+    static const UInt32 kFileBlockSizeMin = (UInt32)1 << 12;
+
+    static const UInt32 kCopyChunkSize = (UInt32)1 << 30;
+
+    static const UInt32 kBatchQueueDepth = 64;
+    static const UInt32 kBatchItemSizeMax = (UInt32)1 << 16;
+
+#ifdef _WIN32
+    static const wchar_t kPathSeparator = L'\\';
+#else
+    static const wchar_t kPathSeparator = L'/';
+    static const UInt32 kAttributeDirectory = 0x10;
+#endif
+
+    // NOTE: the address space is not filled up by a single mapping
+    static const UInt64 kMmapSizeMax = sizeof(size_t) >= 8 ? (UInt64)1 << 44 : (UInt64)1 << 30;
+
+#ifdef _WIN32
+    static const UInt64 kUnixTimeOffset = (UInt64)116444736000000000;
+#endif
+
+    static bool createDirectory(const UString& path) {
+#ifdef _WIN32
+        return CreateDirectoryW(path, NULL) || ::GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        return ::mkdir(us2as(path), 0777) == 0 || errno == EEXIST;
+#endif
+    };
+
+    static bool createDirectories(const UString& path) {
+        if (path.IsEmpty() || createDirectory(path))
+            return true;
+        int separ = path.ReverseFind_PathSepar();
+        if (separ <= 0)
+            return false;
+        if (!createDirectories(path.Left((unsigned)separ)))
+            return false;
+        return createDirectory(path);
+    };
+
+    // NOTE: the parent directories are created if the file cannot be created
+    static HRESULT openOutputFile(const UString& path, CFileHandle*& file) {
+        HRESULT hr = CFileHandle::Open(path, true, file);
+        if (hr == S_OK)
+            return S_OK;
+        int separ = path.ReverseFind_PathSepar();
+        if (separ <= 0 || !createDirectories(path.Left((unsigned)separ)))
+            return hr;
+        return CFileHandle::Open(path, true, file);
+    };
+
+    static HRESULT setPathMode(const UString& path, UInt32 mode) {
+#ifdef _WIN32
+        (void)path;
+        (void)mode;
+        return S_FALSE;
+#else
+        return getResult(::chmod(us2as(path), (mode_t)(mode & 07777)) == 0);
+#endif
+    };
+
+    static HRESULT setPathAttr(const UString& path, UInt32 attr) {
+#ifdef _WIN32
+        return getResult(SetFileAttributesW(path, attr));
+#else
+        (void)path;
+        (void)attr;
+        return S_FALSE;
+#endif
+    };
+
+    static HRESULT setPathTime(const UString& path, UInt32 time) {
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(path, FILE_WRITE_ATTRIBUTES,
+                FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (handle == INVALID_HANDLE_VALUE)
+            return getResult(false);
+        UInt64 value = (UInt64)time * 10000000 + kUnixTimeOffset;
+        FILETIME mtime;
+        mtime.dwLowDateTime = (DWORD)value;
+        mtime.dwHighDateTime = (DWORD)(value >> 32);
+        BOOL result = SetFileTime(handle, NULL, NULL, &mtime);
+        CloseHandle(handle);
+        return getResult(result);
+#else
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = (time_t)time;
+        times[1].tv_nsec = 0;
+        return getResult(::utimensat(AT_FDCWD, us2as(path), times, 0) == 0);
+#endif
+    };
+
+    static bool getStat(const UString& pathname, CFileHandle* file, CFileStat& stat) {
+#ifdef _WIN32
+        (void)file;
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(pathname, GetFileExInfoStandard, &data))
+            return false;
+        UInt64 time = ((UInt64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        stat.size = ((UInt64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        stat.attr = data.dwFileAttributes;
+        stat.isDir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        stat.time = time > kUnixTimeOffset ? (UInt32)((time - kUnixTimeOffset) / 10000000) : 0;
+        stat.mode = stat.isDir ? 040755 : ((data.dwFileAttributes & FILE_ATTRIBUTE_READONLY) ? 0100444 : 0100644);
+#else
+        struct stat st;
+        // NOTE: the opened file is checked by the descriptor without the path lookup
+        int result = file && file->path == pathname ? ::fstat(file->fd, &st) : ::stat(us2as(pathname), &st);
+        if (result != 0)
+            return false;
+        stat.size = (UInt64)st.st_size;
+        stat.mode = (UInt32)st.st_mode;
+        stat.isDir = S_ISDIR(st.st_mode);
+        stat.attr = stat.isDir ? kAttributeDirectory : 0;
+        stat.time = (UInt32)st.st_mtime;
+#endif
+        return true;
+    };
+
+    // NOTE: S_FALSE for a missing destination or a directory, the item is extracted then
+    static HRESULT statOutputFile(const UString& path, UInt64& size, UInt32& time) {
+        CFileStat stat;
+        if (!getStat(path, nullptr, stat) || stat.isDir)
+            return S_FALSE;
+        size = stat.size;
+        time = stat.time;
+        return S_OK;
+    };
+
+    // NOTE: the CRC-32 of the 7z and zip items, the table is built on the first call
+    struct CCrcTable {
+        UInt32 table[256];
+        CCrcTable() {
+            for (UInt32 i = 0; i < 256; i++) {
+                UInt32 r = i;
+                for (int j = 0; j < 8; j++)
+                    r = (r >> 1) ^ (0xEDB88320 & ((UInt32)0 - (r & 1)));
+                table[i] = r;
+            }
+        }
+    };
+
+    static UInt32 updateCrc(UInt32 crc, const void* data, size_t size) {
+        static const CCrcTable crcTable;
+        UInt32 value = crc ^ 0xFFFFFFFF;
+        for (size_t i = 0; i < size; i++)
+            value = crcTable.table[(value ^ ((const Byte*)data)[i]) & 0xFF] ^ (value >> 8);
+        return value ^ 0xFFFFFFFF;
+    };
+
+    static HRESULT getFileCrc(const UString& path, UInt32& crc) {
+        CFileHandle* file;
+        HRESULT hr = CFileHandle::Open(path, false, file);
+        if (hr != S_OK)
+            return hr;
+        CByteBuffer buffer(kFileBlockSize);
+        UInt32 value = 0;
+        UInt64 offset = 0;
+        UInt32 processed = 0;
+        while ((hr = file->ReadAt(offset, buffer, kFileBlockSize, processed)) == S_OK && processed > 0) {
+            value = updateCrc(value, buffer, processed);
+            offset += processed;
+        }
+        file->Release();
+        crc = value;
+        return hr;
+    };
+
+    // file handle
+
+    CFileHandle::CFileHandle() : refs(1) {
+#ifdef _WIN32
+        handle = INVALID_HANDLE_VALUE;
+#else
+        fd = -1;
+#endif
+    };
+
+    CFileHandle::~CFileHandle() {
+        DEBUGLOG(this << " ~CFileHandle");
+#ifdef _WIN32
+        if (view)
+            UnmapViewOfFile(view);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+#else
+        if (view)
+            ::munmap((void*)view, (size_t)viewSize);
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    };
+
+    HRESULT CFileHandle::Open(const UString& path, bool write, CFileHandle*& file) {
+        DEBUGLOG("CFileHandle::Open " << path.Ptr() << " " << write);
+        file = nullptr;
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(path,
+                write ? GENERIC_WRITE : GENERIC_READ,
+                write ? FILE_SHARE_READ : FILE_SHARE_READ | FILE_SHARE_WRITE,
+                NULL,
+                write ? CREATE_ALWAYS : OPEN_EXISTING,
+                write ? FILE_ATTRIBUTE_NORMAL : FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                NULL);
+        if (handle == INVALID_HANDLE_VALUE)
+            return getResult(false);
+        file = new CFileHandle();
+        file->handle = handle;
+#else
+        int flags = write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+#ifdef O_CLOEXEC
+        flags |= O_CLOEXEC;
+#endif
+        int fd;
+        do {
+            fd = ::open(us2as(path), flags, 0666);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0)
+            return getResult(false);
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (!write)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        file = new CFileHandle();
+        file->fd = fd;
+#endif
+        file->path = path;
+        return S_OK;
+    };
+
+#ifndef _WIN32
+    HRESULT CFileHandle::OpenAt(int dirfd, const UString& name, const UString& path, CFileHandle*& file) {
+        DEBUGLOG("CFileHandle::OpenAt " << dirfd << " " << name.Ptr());
+        file = nullptr;
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+        flags |= O_CLOEXEC;
+#endif
+        int fd;
+        do {
+            fd = ::openat(dirfd, us2as(name), flags, 0666);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0)
+            return getResult(false);
+        file = new CFileHandle();
+        file->fd = fd;
+        file->path = path;
+        return S_OK;
+    };
+#endif
+
+    void CFileHandle::AddRef() {
+        refs.fetch_add(1);
+    };
+
+    void CFileHandle::Release() {
+        if (refs.fetch_sub(1) == 1)
+            delete this;
+    };
+
+    HRESULT CFileHandle::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD n = 0;
+        if (!ReadFile(handle, data, size, &n, &overlapped))
+            return ::GetLastError() == ERROR_HANDLE_EOF ? S_OK : getResult(false);
+        processed = n;
+#else
+        ssize_t n;
+        do {
+            n = ::pread(fd, data, size, (off_t)offset);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+            return getResult(false);
+        processed = (UInt32)n;
+#endif
+        return S_OK;
+    };
+
+    HRESULT CFileHandle::WriteAt(UInt64 offset, const void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        while (processed < size) {
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = (DWORD)(offset + processed);
+            overlapped.OffsetHigh = (DWORD)((offset + processed) >> 32);
+            DWORD n = 0;
+            if (!WriteFile(handle, (const Byte*)data + processed, size - processed, &n, &overlapped))
+                return getResult(false);
+#else
+            ssize_t n = ::pwrite(fd, (const Byte*)data + processed, size - processed, (off_t)(offset + processed));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return getResult(false);
+#endif
+            if (n == 0)
+                return E_FAIL;
+            processed += (UInt32)n;
+        }
+        return S_OK;
+    };
+
+    HRESULT CFileHandle::GetSize(UInt64& size) {
+#ifdef _WIN32
+        LARGE_INTEGER value;
+        if (!GetFileSizeEx(handle, &value))
+            return getResult(false);
+        size = (UInt64)value.QuadPart;
+#else
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+            return getResult(false);
+        size = (UInt64)st.st_size;
+#endif
+        return S_OK;
+    };
+
+    HRESULT CFileHandle::SetSize(UInt64 size) {
+#ifdef _WIN32
+        LARGE_INTEGER value;
+        value.QuadPart = (LONGLONG)size;
+        return getResult(SetFilePointerEx(handle, value, NULL, FILE_BEGIN) && SetEndOfFile(handle));
+#else
+        return getResult(::ftruncate(fd, (off_t)size) == 0);
+#endif
+    };
+
+    // NOTE: the file size is not changed, only the space is allocated, so a failed item is left at the
+    // length written; filesystems without fallocate are skipped rather than filled block by block
+    HRESULT CFileHandle::Reserve(UInt64 size) {
+#if defined(_WIN32) && defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600
+        FILE_ALLOCATION_INFO info;
+        info.AllocationSize.QuadPart = (LONGLONG)size;
+        return getResult(SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info)));
+#elif defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0)
+            return S_OK;
+        if (errno == EOPNOTSUPP || errno == ENOSYS)
+            return S_FALSE;
+        return getResult(false);
+#else
+        (void)size;
+        return S_FALSE;
+#endif
+    };
+
+    HRESULT CFileHandle::SetMode(UInt32 mode) {
+#ifdef _WIN32
+        (void)mode;
+        return S_FALSE;
+#else
+        return getResult(::fchmod(fd, (mode_t)(mode & 07777)) == 0);
+#endif
+    };
+
+    HRESULT CFileHandle::SetTime(UInt32 time) {
+#ifdef _WIN32
+        UInt64 value = (UInt64)time * 10000000 + kUnixTimeOffset;
+        FILETIME mtime;
+        mtime.dwLowDateTime = (DWORD)value;
+        mtime.dwHighDateTime = (DWORD)(value >> 32);
+        return getResult(SetFileTime(handle, NULL, NULL, &mtime));
+#else
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = (time_t)time;
+        times[1].tv_nsec = 0;
+        return getResult(::futimens(fd, times) == 0);
+#endif
+    };
+
+    // NOTE: copy_file_range shares the extents or copies in the kernel, sendfile is used if it is not
+    // supported across the filesystems; no data passes through the user space in both cases
+    HRESULT CFileHandle::CopyFrom(CFileHandle* source, UInt64 offset, UInt64 position, UInt64 size, UInt64& processed) {
+        processed = 0;
+#ifdef __linux__
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        bool ranges = true;
+#else
+        bool ranges = false;
+#endif
+        while (processed < size) {
+            size_t chunk = (size_t)min(size - processed, (UInt64)kCopyChunkSize);
+            ssize_t n;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+            if (ranges) {
+                loff_t in = (loff_t)(offset + processed);
+                loff_t out = (loff_t)(position + processed);
+                n = ::copy_file_range(source->fd, &in, fd, &out, chunk, 0);
+                if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    ranges = false;
+                    continue;
+                }
+            } else
+#endif
+            {
+                if (::lseek(fd, (off_t)(position + processed), SEEK_SET) < 0)
+                    return getResult(false);
+                off_t in = (off_t)(offset + processed);
+                n = ::sendfile(fd, source->fd, &in, chunk);
+                if (n < 0 && processed == 0 && (errno == EINVAL || errno == ENOSYS))
+                    return E_NOTIMPL;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return getResult(false);
+            if (n == 0)
+                break;
+            processed += (UInt64)n;
+        }
+        return S_OK;
+#else
+        (void)source;
+        (void)offset;
+        (void)position;
+        (void)size;
+        return E_NOTIMPL;
+#endif
+    };
+
+    // NOTE: S_FALSE means the file is read with positional reads
+    HRESULT CFileHandle::Map() {
+        if (view)
+            return S_OK;
+        UInt64 size = 0;
+        HRESULT hr = GetSize(size);
+        if (hr != S_OK)
+            return hr;
+        UInt64 limit = kMmapSizeMax;
+#ifndef _WIN32
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_AS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+            limit = min(limit, (UInt64)rl.rlim_cur / 2);
+#endif
+        if (size == 0 || size > limit)
+            return S_FALSE;
+#ifdef _WIN32
+        mapping = CreateFileMappingW(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+            return S_FALSE;
+        view = (const Byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+            CloseHandle(mapping);
+            mapping = NULL;
+            return S_FALSE;
+        }
+#else
+        void* address = ::mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED)
+            return S_FALSE;
+        view = (const Byte*)address;
+#endif
+        viewSize = size;
+        DEBUGLOG(this << " CFileHandle::Map " << path.Ptr() << " " << size);
+        return S_OK;
+    };
+
+    // NOTE: madvise for the mapped file, posix_fadvise otherwise
+    HRESULT CFileHandle::Advise(UInt64 offset, UInt64 size, int advice) {
+#ifdef _WIN32
+        (void)offset;
+        (void)size;
+        (void)advice;
+        return S_FALSE;
+#else
+        if (view) {
+            if (offset >= viewSize)
+                return S_OK;
+            if (size == 0 || size > viewSize - offset)
+                size = viewSize - offset;
+            UInt64 page = (UInt64)sysconf(_SC_PAGESIZE);
+            UInt64 end = offset + size;
+            // NOTE: the pages partially out of the range are kept
+            UInt64 start = advice == ADVICE_DONTNEED ? (offset + page - 1) & ~(page - 1) : offset & ~(page - 1);
+            if (advice == ADVICE_DONTNEED && end < viewSize)
+                end &= ~(page - 1);
+            if (start >= end)
+                return S_OK;
+            int flag = advice == ADVICE_SEQUENTIAL ? MADV_SEQUENTIAL
+                    : advice == ADVICE_RANDOM ? MADV_RANDOM
+                    : advice == ADVICE_WILLNEED ? MADV_WILLNEED
+                    : advice == ADVICE_DONTNEED ? MADV_DONTNEED
+                    : MADV_NORMAL;
+            return getResult(::madvise((void*)(view + start), (size_t)(end - start), flag) == 0);
+        }
+#ifdef POSIX_FADV_NORMAL
+        int flag = advice == ADVICE_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL
+                : advice == ADVICE_RANDOM ? POSIX_FADV_RANDOM
+                : advice == ADVICE_WILLNEED ? POSIX_FADV_WILLNEED
+                : advice == ADVICE_DONTNEED ? POSIX_FADV_DONTNEED
+                : POSIX_FADV_NORMAL;
+        int result = posix_fadvise(fd, (off_t)offset, (off_t)size, flag);
+        return result == 0 ? S_OK : HRESULT_FROM_WIN32(result);
+#else
+        (void)offset;
+        (void)size;
+        (void)advice;
+        return S_FALSE;
+#endif
+#endif
+    };
+
+    // NOTE: short reads are repeated up to the end of the file
+    static HRESULT readFileAt(CFileHandle* file, UInt64 offset, void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        if (!file)
+            return E_FAIL;
+        if (file->view) {
+            if (offset < file->viewSize) {
+                processed = (UInt32)min((UInt64)size, file->viewSize - offset);
+                memcpy(data, file->view + offset, processed);
+            }
+            return S_OK;
+        }
+        while (processed < size) {
+            UInt32 n = 0;
+            HRESULT hr = file->ReadAt(offset + processed, (Byte*)data + processed, size - processed, n);
+            if (hr != S_OK)
+                return hr;
+            if (n == 0)
+                break;
+            processed += n;
+        }
+        return S_OK;
+    };
+
+    const CFileStat* CFileStatCache::Get(const wchar_t* pathname, CFileHandle* file) {
+        UString name = pathname ? pathname : L"";
+        if (valid && path == name)
+            return &stat;
+        path = name;
+        valid = getStat(name, file, stat);
+        return valid ? &stat : nullptr;
+    };
+
+    static HRESULT getSeekPosition(CFileHandle* file, UInt64 current, Int64 offset, UInt32 origin, UInt64& position) {
+        UInt64 base = current;
+        if (origin == SZ_SEEK_SET) {
+            base = 0;
+        } else if (origin == SZ_SEEK_END) {
+            HRESULT hr = file->GetSize(base);
+            if (hr != S_OK)
+                return hr;
+        } else if (origin != SZ_SEEK_CUR) {
+            return E_INVALIDARG;
+        }
+        if (offset < 0 && (UInt64)(-offset) > base)
+            return E_INVALIDARG;
+        position = base + offset;
+        return S_OK;
+    };
+
+    // input file stream
+
+    FileIstream::Impl::Impl(UInt32 blockSize) :
+            blockSize(blockSize == 0 ? kFileBlockSize : max(blockSize, kFileBlockSizeMin)) {
+        DEBUGLOG(this << " FileIstream::Impl " << this->blockSize);
+    };
+
+    FileIstream::Impl::~Impl() {
+        DEBUGLOG(this << " ~FileIstream::Impl");
+        close();
+    };
+
+    // NOTE: the shared file is reused if it is the same file
+    HRESULT FileIstream::Impl::open(const wchar_t* filename) {
+        DEBUGLOG(this << " FileIstream::Impl::open " << filename);
+        UString path = filename ? filename : L"";
+        position = 0;
+        bufferLen = 0;
+        if (file && file->path == path)
+            return S_OK;
+        close();
+        return CFileHandle::Open(path, false, file);
+    };
+
+    void FileIstream::Impl::close() {
+        if (file)
+            file->Release();
+        file = nullptr;
+        position = 0;
+        bufferLen = 0;
+    };
+
+    void FileIstream::Impl::share(const Impl* impl) {
+        close();
+        file = impl->file;
+        if (file)
+            file->AddRef();
+    };
+
+    // NOTE: small reads are served from the block buffer, large reads bypass it
+    HRESULT FileIstream::Impl::read(void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        if (!file)
+            return E_FAIL;
+        while (size > 0) {
+            if (position >= bufferPos && position < bufferPos + bufferLen) {
+                UInt32 n = (UInt32)min((UInt64)size, bufferPos + bufferLen - position);
+                memcpy((Byte*)data + processed, (const Byte*)buffer + (size_t)(position - bufferPos), n);
+                position += n;
+                processed += n;
+                size -= n;
+                continue;
+            }
+            UInt32 n = 0;
+            if (size >= blockSize) {
+                HRESULT hr = file->ReadAt(position, (Byte*)data + processed, size, n);
+                if (hr != S_OK)
+                    return hr;
+                if (n == 0)
+                    break;
+                position += n;
+                processed += n;
+                size -= n;
+                continue;
+            }
+            if (buffer.Size() != blockSize)
+                buffer.Alloc(blockSize);
+            bufferLen = 0;
+            HRESULT hr = file->ReadAt(position, buffer, blockSize, n);
+            if (hr != S_OK)
+                return hr;
+            if (n == 0)
+                break;
+            bufferPos = position;
+            bufferLen = n;
+        }
+        return S_OK;
+    };
+
+    // NOTE: the block buffer is not used, positional reads can be concurrent
+    HRESULT FileIstream::Impl::readAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) {
+        return readFileAt(file, offset, data, size, processed);
+    };
+
+    HRESULT FileIstream::Impl::advise(UInt64 offset, UInt64 size, int advice) {
+        return file ? file->Advise(offset, size, advice) : E_FAIL;
+    };
+
+    HRESULT FileIstream::Impl::seek(Int64 offset, UInt32 origin, UInt64& position) {
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = getSeekPosition(file, this->position, offset, origin, this->position);
+        position = this->position;
+        return hr;
+    };
+
+    const CFileStat* FileIstream::Impl::getStat(const wchar_t* pathname) {
+        return stats.Get(pathname, file);
+    };
+
+    CFileHandle* FileIstream::Impl::getFile() const {
+        return file;
+    };
+
+    // memory mapped input file stream
+
+    MmapIstream::Impl::Impl() {
+        DEBUGLOG(this << " MmapIstream::Impl");
+    };
+
+    MmapIstream::Impl::~Impl() {
+        DEBUGLOG(this << " ~MmapIstream::Impl");
+        close();
+    };
+
+    // NOTE: the shared file is reused with its mapping if it is the same file
+    HRESULT MmapIstream::Impl::open(const wchar_t* filename) {
+        DEBUGLOG(this << " MmapIstream::Impl::open " << filename);
+        UString path = filename ? filename : L"";
+        position = 0;
+        if (file && file->path == path)
+            return S_OK;
+        close();
+        HRESULT hr = CFileHandle::Open(path, false, file);
+        if (hr != S_OK)
+            return hr;
+        hr = file->Map();
+        return FAILED(hr) ? hr : S_OK;
+    };
+
+    void MmapIstream::Impl::close() {
+        if (file)
+            file->Release();
+        file = nullptr;
+        position = 0;
+    };
+
+    void MmapIstream::Impl::share(const Impl* impl) {
+        close();
+        file = impl->file;
+        if (file)
+            file->AddRef();
+    };
+
+    bool MmapIstream::Impl::isMapped() const {
+        return file && file->view;
+    };
+
+    HRESULT MmapIstream::Impl::read(void* data, UInt32 size, UInt32& processed) {
+        HRESULT hr = readFileAt(file, position, data, size, processed);
+        position += processed;
+        return hr;
+    };
+
+    HRESULT MmapIstream::Impl::readAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) {
+        return readFileAt(file, offset, data, size, processed);
+    };
+
+    HRESULT MmapIstream::Impl::seek(Int64 offset, UInt32 origin, UInt64& position) {
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = getSeekPosition(file, this->position, offset, origin, this->position);
+        position = this->position;
+        return hr;
+    };
+
+    HRESULT MmapIstream::Impl::advise(UInt64 offset, UInt64 size, int advice) {
+        return file ? file->Advise(offset, size, advice) : E_FAIL;
+    };
+
+    const CFileStat* MmapIstream::Impl::getStat(const wchar_t* pathname) {
+        return stats.Get(pathname, file);
+    };
+
+    CFileHandle* MmapIstream::Impl::getFile() const {
+        return file;
+    };
+
+    CFileHandle* CFileSource::Get(Istream& istream) {
+        if (FileIstream* file = dynamic_cast<FileIstream*>(&istream))
+            return file->pimpl->getFile();
+        if (MmapIstream* mapped = dynamic_cast<MmapIstream*>(&istream))
+            return mapped->pimpl->getFile();
+        return nullptr;
+    };
+
+    // output file stream
+
+    FileOstream::Impl::Impl(const wchar_t* basepath) : basepath(basepath ? basepath : L"") {
+        DEBUGLOG(this << " FileOstream::Impl " << this->basepath.Ptr());
+    };
+
+    FileOstream::Impl::~Impl() {
+        DEBUGLOG(this << " ~FileOstream::Impl");
+        close();
+    };
+
+    UString FileOstream::Impl::getFullPath(const wchar_t* path) const {
+        if (basepath.IsEmpty())
+            return path ? path : L"";
+        UString fullpath = basepath;
+        fullpath += kPathSeparator;
+        fullpath += path ? path : L"";
+        return fullpath;
+    };
+
+    HRESULT FileOstream::Impl::open(const wchar_t* filename) {
+        DEBUGLOG(this << " FileOstream::Impl::open " << filename);
+        close();
+        return openOutputFile(getFullPath(filename), file);
+    };
+
+    void FileOstream::Impl::close() {
+        if (file)
+            file->Release();
+        file = nullptr;
+        position = 0;
+    };
+
+    HRESULT FileOstream::Impl::write(const void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = file->WriteAt(position, data, size, processed);
+        position += processed;
+        return hr;
+    };
+
+    HRESULT FileOstream::Impl::seek(Int64 offset, UInt32 origin, UInt64& position) {
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = getSeekPosition(file, this->position, offset, origin, this->position);
+        position = this->position;
+        return hr;
+    };
+
+    HRESULT FileOstream::Impl::setSize(UInt64 size) {
+        return file ? file->SetSize(size) : E_FAIL;
+    };
+
+    HRESULT FileOstream::Impl::reserve(UInt64 size) {
+        return file ? file->Reserve(size) : E_FAIL;
+    };
+
+    HRESULT FileOstream::Impl::mkdir(const wchar_t* dirname) {
+        return getResult(createDirectories(getFullPath(dirname)));
+    };
+
+    HRESULT FileOstream::Impl::setMode(const wchar_t* path, UInt32 mode) {
+        return setPathMode(getFullPath(path), mode);
+    };
+
+    HRESULT FileOstream::Impl::setAttr(const wchar_t* path, UInt32 attr) {
+        return setPathAttr(getFullPath(path), attr);
+    };
+
+    HRESULT FileOstream::Impl::setTime(const wchar_t* path, UInt32 time) {
+        return setPathTime(getFullPath(path), time);
+    };
+
+    HRESULT FileOstream::Impl::stat(const wchar_t* path, UInt64& size, UInt32& time) {
+        return statOutputFile(getFullPath(path), size, time);
+    };
+
+    HRESULT FileOstream::Impl::getCrc(const wchar_t* path, UInt32& crc) {
+        return getFileCrc(getFullPath(path), crc);
+    };
+
+    // NOTE: the data is copied at the current position, which is moved past it
+    HRESULT FileOstream::Impl::writeFrom(CFileHandle* source, UInt64 offset, UInt64 size, UInt64& processed) {
+        processed = 0;
+        if (!source)
+            return E_NOTIMPL;
+        if (size == 0)
+            return S_OK;
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = file->CopyFrom(source, offset, position, size, processed);
+        position += processed;
+        return hr;
+    };
+
+    // directory cache
+
+    static void splitPath(const UString& path, UString& parent, UString& name) {
+        int separ = path.ReverseFind_PathSepar();
+        parent = separ < 0 ? UString() : path.Left((unsigned)separ);
+        name = separ < 0 ? path : UString(path.Ptr((unsigned)separ + 1));
+    };
+
+    CDirectoryCache::CDirectoryCache(const wchar_t* root) : root(root ? root : L"") {};
+
+    CDirectoryCache::~CDirectoryCache() {
+#ifndef _WIN32
+        trim();
+        if (rootfd >= 0)
+            ::close(rootfd);
+#endif
+    };
+
+    UString CDirectoryCache::getFullPath(const UString& path) const {
+        if (root.IsEmpty())
+            return path;
+        UString fullpath = root;
+        fullpath += kPathSeparator;
+        fullpath += path;
+        return fullpath;
+    };
+
+#ifdef _WIN32
+
+    // NOTE: no handle relative calls, only the created directories are cached
+    HRESULT CDirectoryCache::OpenFile(const UString& path, CFileHandle*& file) {
+        UString parent, name;
+        splitPath(path, parent, name);
+        if (!parent.IsEmpty()) {
+            HRESULT hr = MakeDirectory(parent);
+            if (hr != S_OK)
+                return hr;
+        }
+        return CFileHandle::Open(getFullPath(path), true, file);
+    };
+
+    HRESULT CDirectoryCache::MakeDirectory(const UString& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (created.find(path.Ptr()) != created.end())
+            return S_OK;
+        if (!createDirectories(getFullPath(path)))
+            return getResult(false);
+        created.insert(path.Ptr());
+        return S_OK;
+    };
+
+    HRESULT CDirectoryCache::SetMode(const UString& path, UInt32 mode) {
+        return setPathMode(getFullPath(path), mode);
+    };
+
+    HRESULT CDirectoryCache::SetAttr(const UString& path, UInt32 attr) {
+        return setPathAttr(getFullPath(path), attr);
+    };
+
+    HRESULT CDirectoryCache::SetTime(const UString& path, UInt32 time) {
+        return setPathTime(getFullPath(path), time);
+    };
+
+#else
+
+    static const size_t kDirectoryHandlesMax = 256;
+
+    static int openDirectory(int dirfd, const char* name) {
+        int flags = O_RDONLY | O_DIRECTORY;
+#ifdef O_CLOEXEC
+        flags |= O_CLOEXEC;
+#endif
+        int fd;
+        do {
+            fd = ::openat(dirfd, name, flags);
+        } while (fd < 0 && errno == EINTR);
+        return fd;
+    };
+
+    // NOTE: called before a lookup only, so the handles of the chain being resolved stay open
+    void CDirectoryCache::trim() {
+        for (auto it = handles.begin(); it != handles.end(); ++it)
+            ::close(it->second);
+        handles.clear();
+    };
+
+    HRESULT CDirectoryCache::getRoot(int& dirfd) {
+        if (rootfd < 0) {
+            AString path = root.IsEmpty() ? AString(".") : us2as(root);
+            rootfd = openDirectory(AT_FDCWD, path);
+            if (rootfd < 0 && errno == ENOENT && createDirectories(root))
+                rootfd = openDirectory(AT_FDCWD, path);
+            if (rootfd < 0)
+                return getResult(false);
+        }
+        dirfd = rootfd;
+        return S_OK;
+    };
+
+    HRESULT CDirectoryCache::getDirectory(const UString& path, int& dirfd) {
+        if (path.IsEmpty())
+            return getRoot(dirfd);
+        std::wstring key(path.Ptr());
+        auto it = handles.find(key);
+        if (it != handles.end()) {
+            dirfd = it->second;
+            return S_OK;
+        }
+        int parentfd;
+        UString name;
+        HRESULT hr = getParent(path, parentfd, name);
+        if (hr != S_OK)
+            return hr;
+        AString aname = us2as(name);
+        if (created.find(key) == created.end()) {
+            if (::mkdirat(parentfd, aname, 0777) != 0 && errno != EEXIST)
+                return getResult(false);
+            created.insert(key);
+        }
+        int fd = openDirectory(parentfd, aname);
+        if (fd < 0)
+            return getResult(false);
+        handles[key] = fd;
+        dirfd = fd;
+        return S_OK;
+    };
+
+    HRESULT CDirectoryCache::getParent(const UString& path, int& dirfd, UString& name) {
+        UString parent;
+        splitPath(path, parent, name);
+        return getDirectory(parent, dirfd);
+    };
+
+    HRESULT CDirectoryCache::OpenFile(const UString& path, CFileHandle*& file) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (handles.size() >= kDirectoryHandlesMax)
+            trim();
+        int dirfd;
+        UString name;
+        HRESULT hr = getParent(path, dirfd, name);
+        if (hr != S_OK)
+            return hr;
+        return CFileHandle::OpenAt(dirfd, name, getFullPath(path), file);
+    };
+
+    HRESULT CDirectoryCache::MakeDirectory(const UString& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (handles.size() >= kDirectoryHandlesMax)
+            trim();
+        int dirfd;
+        return getDirectory(path, dirfd);
+    };
+
+    HRESULT CDirectoryCache::SetMode(const UString& path, UInt32 mode) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int dirfd;
+        UString name;
+        HRESULT hr = getParent(path, dirfd, name);
+        if (hr != S_OK)
+            return hr;
+        return getResult(::fchmodat(dirfd, us2as(name), (mode_t)(mode & 07777), 0) == 0);
+    };
+
+    HRESULT CDirectoryCache::SetAttr(const UString& path, UInt32 attr) {
+        (void)path;
+        (void)attr;
+        return S_FALSE;
+    };
+
+    HRESULT CDirectoryCache::SetTime(const UString& path, UInt32 time) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int dirfd;
+        UString name;
+        HRESULT hr = getParent(path, dirfd, name);
+        if (hr != S_OK)
+            return hr;
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = (time_t)time;
+        times[1].tv_nsec = 0;
+        return getResult(::utimensat(dirfd, us2as(name), times, 0) == 0);
+    };
+
+#endif
+
+    // NOTE: the checks do not create the parent directories and do not use the handles
+    HRESULT CDirectoryCache::Stat(const UString& path, UInt64& size, UInt32& time) {
+        return statOutputFile(getFullPath(path), size, time);
+    };
+
+    HRESULT CDirectoryCache::GetCrc(const UString& path, UInt32& crc) {
+        return getFileCrc(getFullPath(path), crc);
+    };
+
+    // directory output stream
+
+    DirectoryOstream::Impl::Impl(const wchar_t* basepath) : dirs(basepath) {
+        DEBUGLOG(this << " DirectoryOstream::Impl " << basepath);
+    };
+
+    DirectoryOstream::Impl::~Impl() {
+        DEBUGLOG(this << " ~DirectoryOstream::Impl");
+        close();
+    };
+
+    HRESULT DirectoryOstream::Impl::open(const wchar_t* filename) {
+        DEBUGLOG(this << " DirectoryOstream::Impl::open " << filename);
+        close();
+        return dirs.OpenFile(filename ? filename : L"", file);
+    };
+
+    void DirectoryOstream::Impl::close() {
+        if (file)
+            file->Release();
+        file = nullptr;
+        position = 0;
+    };
+
+    HRESULT DirectoryOstream::Impl::write(const void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = file->WriteAt(position, data, size, processed);
+        position += processed;
+        return hr;
+    };
+
+    HRESULT DirectoryOstream::Impl::seek(Int64 offset, UInt32 origin, UInt64& position) {
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = getSeekPosition(file, this->position, offset, origin, this->position);
+        position = this->position;
+        return hr;
+    };
+
+    HRESULT DirectoryOstream::Impl::setSize(UInt64 size) {
+        return file ? file->SetSize(size) : E_FAIL;
+    };
+
+    HRESULT DirectoryOstream::Impl::reserve(UInt64 size) {
+        return file ? file->Reserve(size) : E_FAIL;
+    };
+
+    HRESULT DirectoryOstream::Impl::mkdir(const wchar_t* dirname) {
+        return dirs.MakeDirectory(dirname ? dirname : L"");
+    };
+
+    HRESULT DirectoryOstream::Impl::setMode(const wchar_t* path, UInt32 mode) {
+        return dirs.SetMode(path ? path : L"", mode);
+    };
+
+    HRESULT DirectoryOstream::Impl::setAttr(const wchar_t* path, UInt32 attr) {
+        return dirs.SetAttr(path ? path : L"", attr);
+    };
+
+    HRESULT DirectoryOstream::Impl::setTime(const wchar_t* path, UInt32 time) {
+        return dirs.SetTime(path ? path : L"", time);
+    };
+
+    HRESULT DirectoryOstream::Impl::stat(const wchar_t* path, UInt64& size, UInt32& time) {
+        return dirs.Stat(path ? path : L"", size, time);
+    };
+
+    HRESULT DirectoryOstream::Impl::getCrc(const wchar_t* path, UInt32& crc) {
+        return dirs.GetCrc(path ? path : L"", crc);
+    };
+
+    HRESULT DirectoryOstream::Impl::writeFrom(CFileHandle* source, UInt64 offset, UInt64 size, UInt64& processed) {
+        processed = 0;
+        if (!source)
+            return E_NOTIMPL;
+        if (size == 0)
+            return S_OK;
+        if (!file)
+            return E_FAIL;
+        HRESULT hr = file->CopyFrom(source, offset, position, size, processed);
+        position += processed;
+        return hr;
+    };
+
+#ifdef SEVENZIP_IO_URING
+
+    // io_uring submission ring
+
+    enum {
+        kUringOpen,
+        kUringWrite,
+        kUringClose
+    };
+
+    static int uringSetup(unsigned entries, io_uring_params* params) {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    };
+
+    static int uringEnter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+    };
+
+    static int uringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+        return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+    };
+
+    // NOTE: nullptr if the kernel has no io_uring or is older than 5.17
+    CBatchUring* CBatchUring::Create(unsigned slots) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = uringSetup(slots * 3, &params);
+        if (fd < 0)
+            return nullptr;
+        CBatchUring* uring = new CBatchUring(fd, slots);
+        if (!uring->init(params)) {
+            delete uring;
+            return nullptr;
+        }
+        return uring;
+    };
+
+    CBatchUring::~CBatchUring() {
+        if (sqes)
+            munmap(sqes, sqesSize);
+        if (ring)
+            munmap(ring, ringSize);
+        ::close(fd);
+    };
+
+    // NOTE: direct descriptors of openat and close need a sparse table of registered files
+    bool CBatchUring::init(const io_uring_params& params) {
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_CQE_SKIP))
+            return false;
+        size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ringSize = max(sqSize, cqSize);
+        ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ring == MAP_FAILED) {
+            ring = nullptr;
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            sqes = nullptr;
+            return false;
+        }
+        char* base = (char*)ring;
+        sqHead = (unsigned*)(base + params.sq_off.head);
+        sqTail = (unsigned*)(base + params.sq_off.tail);
+        sqArray = (unsigned*)(base + params.sq_off.array);
+        sqMask = *(unsigned*)(base + params.sq_off.ring_mask);
+        sqLocal = *sqTail;
+        cqHead = (unsigned*)(base + params.cq_off.head);
+        cqTail = (unsigned*)(base + params.cq_off.tail);
+        cqes = base + params.cq_off.cqes;
+        cqMask = *(unsigned*)(base + params.cq_off.ring_mask);
+
+        const unsigned count = 256;
+        CByteBuffer buffer(sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op));
+        memset(buffer, 0, buffer.Size());
+        io_uring_probe* probe = (io_uring_probe*)(Byte*)buffer;
+        if (uringRegister(fd, IORING_REGISTER_PROBE, probe, count) < 0)
+            return false;
+        const unsigned ops[] = { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE };
+        for (unsigned i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+            if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+                return false;
+
+        std::vector<int> files(slots, -1);
+        return uringRegister(fd, IORING_REGISTER_FILES, files.data(), slots) == 0;
+    };
+
+    io_uring_sqe* CBatchUring::getSqe() {
+        unsigned index = sqLocal & sqMask;
+        io_uring_sqe* sqe = (io_uring_sqe*)sqes + index;
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        sqLocal++;
+        return sqe;
+    };
+
+    // NOTE: the chain only creates new files, the mode is applied by openat; it is cut by a failed
+    // or short operation, the rest completes with -ECANCELED; the path and the data must be kept
+    // until the completions
+    void CBatchUring::Queue(unsigned slot, const char* path, const void* data, UInt32 size, UInt32 mode) {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (UInt64)(uintptr_t)path;
+        sqe->len = mode;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL;
+        sqe->file_index = slot + 1;
+        sqe->user_data = (UInt64)slot * 4 + kUringOpen;
+        if (size > 0) {
+            sqe = getSqe();
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+            sqe->fd = (int)slot;
+            sqe->addr = (UInt64)(uintptr_t)data;
+            sqe->len = size;
+            sqe->user_data = (UInt64)slot * 4 + kUringWrite;
+        }
+        sqe = getSqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = slot + 1;
+        sqe->user_data = (UInt64)slot * 4 + kUringClose;
+    };
+
+    // NOTE: submits the queued chains and waits for a completion
+    HRESULT CBatchUring::Submit() {
+        __atomic_store_n(sqTail, sqLocal, __ATOMIC_RELEASE);
+        unsigned count = sqLocal - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        while (uringEnter(fd, count, 1, IORING_ENTER_GETEVENTS) < 0) {
+            if (errno == EAGAIN || errno == EBUSY)
+                count = 0;
+            else if (errno != EINTR)
+                return getResult(false);
+        }
+        return S_OK;
+    };
+
+    // NOTE: waits for a completion of the submitted chains
+    HRESULT CBatchUring::Wait() {
+        while (uringEnter(fd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+            if (errno != EINTR)
+                return getResult(false);
+        return S_OK;
+    };
+
+    // NOTE: takes back the last queued entry not taken by the kernel, it is never completed
+    bool CBatchUring::Unqueue(unsigned& slot, unsigned& op) {
+        if (sqLocal == __atomic_load_n(sqHead, __ATOMIC_ACQUIRE))
+            return false;
+        sqLocal--;
+        io_uring_sqe* sqe = (io_uring_sqe*)sqes + (sqLocal & sqMask);
+        slot = (unsigned)(sqe->user_data / 4);
+        op = (unsigned)(sqe->user_data % 4);
+        __atomic_store_n(sqTail, sqLocal, __ATOMIC_RELEASE);
+        return true;
+    };
+
+    bool CBatchUring::Reap(unsigned& slot, unsigned& op, int& res) {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            return false;
+        io_uring_cqe* cqe = (io_uring_cqe*)cqes + (head & cqMask);
+        slot = (unsigned)(cqe->user_data / 4);
+        op = (unsigned)(cqe->user_data % 4);
+        res = cqe->res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    };
+
+    // NOTE: closes the file left in the slot by a cut chain
+    void CBatchUring::Release(unsigned slot) {
+        int none = -1;
+        io_uring_files_update update;
+        memset(&update, 0, sizeof(update));
+        update.offset = slot;
+        update.fds = (UInt64)(uintptr_t)&none;
+        uringRegister(fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+    };
+
+    // NOTE: the umask is read from /proc, umask() would change it for the other threads
+    static UInt32 getUmask() {
+        UInt32 mask = 07777;
+        FILE* file = fopen("/proc/self/status", "r");
+        if (!file)
+            return mask;
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "Umask:", 6) == 0) {
+                mask = (UInt32)strtoul(line + 6, NULL, 8);
+                break;
+            }
+        }
+        fclose(file);
+        return mask;
+    };
+
+#endif
+
+    // batched output file stream
+
+    BatchFileOstream::Impl::Impl(const wchar_t* basepath, int numThreads, UInt32 queueDepth, UInt32 itemSizeMax, bool ioUring) :
+            basepath(basepath ? basepath : L""),
+            numThreads(numThreads > 0 ? (unsigned)numThreads : (unsigned)getNumberOfThreads()),
+            itemSizeMax(itemSizeMax == 0 ? kBatchItemSizeMax : itemSizeMax) {
+        DEBUGLOG(this << " BatchFileOstream::Impl " << this->basepath.Ptr() << " " << this->numThreads);
+        for (UInt32 i = 0; i < (queueDepth == 0 ? kBatchQueueDepth : queueDepth); i++)
+            queue.Add(nullptr);
+#ifdef SEVENZIP_IO_URING
+        if (ioUring)
+            uring = CBatchUring::Create(queue.Size());
+        if (uring)
+            umaskBits = getUmask();
+#else
+        (void)ioUring;
+#endif
+    };
+
+    // NOTE: the error of the items not flushed by the caller cannot be returned, it is only logged
+    BatchFileOstream::Impl::~Impl() {
+        DEBUGLOG(this << " ~BatchFileOstream::Impl");
+        HRESULT hr = flush();
+        DEBUGLOG(this << " ~BatchFileOstream::Impl flush " << hr << " " << errorPath.Ptr());
+        (void)hr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+        for (unsigned i = 0; i < spare.Size(); i++)
+            delete spare[i];
+#ifdef SEVENZIP_IO_URING
+        delete uring;
+#endif
+    };
+
+    UString BatchFileOstream::Impl::getFullPath(const wchar_t* path) const {
+        if (basepath.IsEmpty())
+            return path ? path : L"";
+        UString fullpath = basepath;
+        fullpath += kPathSeparator;
+        fullpath += path ? path : L"";
+        return fullpath;
+    };
+
+    // NOTE: the metadata of the closed current item or a queued item is written with it, the item
+    // being written is waited for, the metadata of other paths is set directly
+    CBatchItem* BatchFileOstream::Impl::getItem(const UString& path, std::unique_lock<std::mutex>& lock) {
+        if (current && current->closed && current->path == path)
+            return current;
+        while (true) {
+            for (unsigned i = 0; i < queued; i++) {
+                CBatchItem* item = queue[(head + i) % queue.Size()];
+                if (item->path == path)
+                    return item;
+            }
+            bool written = false;
+            for (unsigned i = 0; i < running.Size() && !written; i++)
+                written = running[i]->path == path;
+            if (!written)
+                return nullptr;
+            cond.wait(lock);
+        }
+    };
+
+    // NOTE: the metadata errors are ignored as by the extract callback
+    HRESULT BatchFileOstream::Impl::writeItem(CBatchItem* item) {
+        CFileHandle* file = item->file;
+        item->file = nullptr;
+        HRESULT hr = file ? S_OK : openOutputFile(item->path, file);
+        if (hr == S_OK && item->size > 0) {
+            UInt32 processed = 0;
+            hr = file->WriteAt(0, item->data, (UInt32)item->size, processed);
+        }
+        if (hr == S_OK && item->hasTime)
+            file->SetTime(item->time);
+        if (hr == S_OK && item->hasMode)
+            file->SetMode(item->mode);
+        if (file)
+            file->Release();
+        if (hr == S_OK && item->hasAttr)
+            setPathAttr(item->path, item->attr);
+        return hr;
+    };
+
+    void BatchFileOstream::Impl::run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (queued == 0) {
+                if (stop)
+                    break;
+                cond.wait(lock);
+                continue;
+            }
+            CBatchItem* item = queue[head];
+            head = (head + 1) % queue.Size();
+            queued--;
+            running.Add(item);
+            cond.notify_all();
+            lock.unlock();
+            HRESULT hr = writeItem(item);
+            DEBUGLOG(this << " BatchFileOstream::Impl::run " << item->path.Ptr() << " hr " << hr);
+            lock.lock();
+            releaseItem(item, hr);
+            cond.notify_all();
+        }
+    };
+
+    // NOTE: called locked, the written item goes to the spare items unless its buffer can still be
+    // used by the kernel
+    void BatchFileOstream::Impl::releaseItem(CBatchItem* item, HRESULT hr, bool reuse) {
+        for (unsigned i = 0; i < running.Size(); i++) {
+            if (running[i] == item) {
+                running.Delete(i);
+                break;
+            }
+        }
+        if (hr != S_OK && result == S_OK) {
+            result = hr;
+            resultPath = item->path;
+        }
+        item->size = 0;
+        item->position = 0;
+        item->hasMode = item->hasAttr = item->hasTime = item->closed = false;
+        if (reuse)
+            spare.Add(item);
+    };
+
+#ifdef SEVENZIP_IO_URING
+
+    // NOTE: the queued items are taken while the slots are free, the large items opened directly
+    // are closed by writeItem; the submitted chains are reaped by slot and the items done are
+    // released together; after a submit failure the entries not taken by the kernel are dropped,
+    // the chains taken are waited for before their items are redone, the new items are written by
+    // writeItem only; the items of the chains that cannot be waited for are failed and not reused
+    void BatchFileOstream::Impl::runUring() {
+        std::vector<CBatchSlot> slots(uring->Slots());
+        std::vector<CBatchItem*> items;
+        std::vector<CBatchItem*> done;
+        std::vector<HRESULT> results;
+        unsigned inflight = 0;
+        bool failed = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            items.clear();
+            while (queued > 0 && inflight + items.size() < slots.size()) {
+                CBatchItem* item = queue[head];
+                head = (head + 1) % queue.Size();
+                queued--;
+                running.Add(item);
+                items.push_back(item);
+            }
+            if (items.empty() && inflight == 0) {
+                if (stop)
+                    break;
+                cond.wait(lock);
+                continue;
+            }
+            cond.notify_all();
+            lock.unlock();
+            done.clear();
+            results.clear();
+            unsigned next = 0;
+            for (size_t i = 0; i < items.size(); i++) {
+                CBatchItem* item = items[i];
+                if (item->file || failed) {
+                    done.push_back(item);
+                    results.push_back(writeItem(item));
+                    continue;
+                }
+                while (slots[next].item)
+                    next++;
+                CBatchSlot& slot = slots[next];
+                slot.item = item;
+                slot.path = us2as(item->path);
+                slot.pending = item->size > 0 ? 3 : 2;
+                slot.opened = slot.closed = -ECANCELED;
+                slot.written = 0;
+                uring->Queue(next, slot.path, item->data, (UInt32)item->size,
+                        item->hasMode ? (item->mode & 07777) : 0666);
+                inflight++;
+            }
+            unsigned index, op;
+            int res;
+            HRESULT hr = S_OK;
+            if (inflight > 0 && !failed && uring->Submit() != S_OK) {
+                failed = true;
+                while (uring->Unqueue(index, op))
+                    slots[index].pending--;
+            }
+            else if (inflight > 0 && failed)
+                hr = uring->Wait();
+            for (unsigned i = 0; failed && i < slots.size(); i++) {
+                if (slots[i].item && slots[i].pending == 0) {
+                    done.push_back(slots[i].item);
+                    results.push_back(finishSlot(slots[i], i));
+                    slots[i].item = nullptr;
+                    inflight--;
+                }
+            }
+            while (uring->Reap(index, op, res)) {
+                CBatchSlot& slot = slots[index];
+                if (!slot.item)
+                    continue;
+                if (op == kUringOpen)
+                    slot.opened = res;
+                else if (op == kUringWrite)
+                    slot.written = res;
+                else
+                    slot.closed = res;
+                if (--slot.pending == 0) {
+                    done.push_back(slot.item);
+                    results.push_back(finishSlot(slot, index));
+                    slot.item = nullptr;
+                    inflight--;
+                }
+            }
+            lock.lock();
+            for (size_t i = 0; i < done.size(); i++)
+                releaseItem(done[i], results[i]);
+            for (unsigned i = 0; hr != S_OK && i < slots.size(); i++) {
+                if (slots[i].item) {
+                    releaseItem(slots[i].item, hr, false);
+                    slots[i].item = nullptr;
+                    slots[i].pending = 0;
+                    inflight--;
+                }
+            }
+            cond.notify_all();
+        }
+    };
+
+    // NOTE: the chain has created the file with the mode, it is set again by pathname only if the
+    // umask has cleared some of its bits, the time is set by pathname; a cut chain is redone by
+    // writeItem, which overwrites the existing file, creates the missing parent directories and
+    // returns the error
+    HRESULT BatchFileOstream::Impl::finishSlot(CBatchSlot& slot, unsigned index) {
+        CBatchItem* item = slot.item;
+        DEBUGLOG(this << " BatchFileOstream::Impl::finishSlot " << item->path.Ptr() << " "
+                << slot.opened << " " << slot.written << " " << slot.closed);
+        if (slot.opened >= 0 && slot.closed < 0)
+            uring->Release(index);
+        if (slot.opened < 0 || slot.written != (int)item->size || slot.closed < 0)
+            return writeItem(item);
+        if (item->hasTime)
+            setPathTime(item->path, item->time);
+        if (item->hasMode && (item->mode & 07777 & umaskBits) != 0)
+            setPathMode(item->path, item->mode);
+        if (item->hasAttr)
+            setPathAttr(item->path, item->attr);
+        return S_OK;
+    };
+
+#endif
+
+    void BatchFileOstream::Impl::submit() {
+        std::unique_lock<std::mutex> lock(mutex);
+        CBatchItem* item = current;
+        current = nullptr;
+        if (item) {
+            if (threads.empty()) {
+#ifdef SEVENZIP_IO_URING
+                if (uring)
+                    threads.emplace_back(&BatchFileOstream::Impl::runUring, this);
+#endif
+                for (unsigned i = 0; i < numThreads && !uring; i++)
+                    threads.emplace_back(&BatchFileOstream::Impl::run, this);
+            }
+            cond.wait(lock, [this] { return queued < queue.Size(); });
+            queue[(head + queued) % queue.Size()] = item;
+            queued++;
+            cond.notify_all();
+        }
+    };
+
+    // NOTE: the item is too large to be kept in memory, the buffered data is written here
+    HRESULT BatchFileOstream::Impl::openDirect(CBatchItem* item) {
+        HRESULT hr = openOutputFile(item->path, item->file);
+        if (hr != S_OK)
+            return hr;
+        UInt32 processed = 0;
+        hr = item->file->WriteAt(0, item->data, (UInt32)item->size, processed);
+        item->position = item->size;
+        item->size = 0;
+        return hr;
+    };
+
+    HRESULT BatchFileOstream::Impl::open(const wchar_t* filename) {
+        DEBUGLOG(this << " BatchFileOstream::Impl::open " << filename);
+        submit();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (spare.Size() > 0) {
+                current = spare.Back();
+                spare.DeleteBack();
+            }
+        }
+        if (!current)
+            current = new CBatchItem();
+        current->path = getFullPath(filename);
+        return S_OK;
+    };
+
+    void BatchFileOstream::Impl::close() {
+        if (current)
+            current->closed = true;
+    };
+
+    HRESULT BatchFileOstream::Impl::write(const void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        if (!current || current->closed)
+            return E_FAIL;
+        CBatchItem* item = current;
+        if (!item->file && item->size + size > itemSizeMax) {
+            HRESULT hr = openDirect(item);
+            if (hr != S_OK)
+                return hr;
+        }
+        if (item->file) {
+            HRESULT hr = item->file->WriteAt(item->position, data, size, processed);
+            item->position += processed;
+            return hr;
+        }
+        if (item->data.Size() < item->size + size)
+            item->data.ChangeSize_KeepData(min(max(item->size + size, item->data.Size() * 2), (size_t)itemSizeMax), item->size);
+        memcpy((Byte*)item->data + item->size, data, size);
+        item->size += size;
+        processed = size;
+        return S_OK;
+    };
+
+    // NOTE: the buffer is sized once for a small item, a large item is written directly
+    HRESULT BatchFileOstream::Impl::reserve(UInt64 size) {
+        if (!current || current->closed)
+            return E_FAIL;
+        if (current->file)
+            return current->file->Reserve(size);
+        if (size > itemSizeMax) {
+            HRESULT hr = openDirect(current);
+            return hr == S_OK ? current->file->Reserve(size) : hr;
+        }
+        if (current->data.Size() < (size_t)size)
+            current->data.ChangeSize_KeepData((size_t)size, current->size);
+        return S_OK;
+    };
+
+    HRESULT BatchFileOstream::Impl::mkdir(const wchar_t* dirname) {
+        submit();
+        return getResult(createDirectories(getFullPath(dirname)));
+    };
+
+    HRESULT BatchFileOstream::Impl::setMode(const wchar_t* path, UInt32 mode) {
+        UString fullpath = getFullPath(path);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            CBatchItem* item = getItem(fullpath, lock);
+            if (item) {
+                item->mode = mode;
+                item->hasMode = true;
+                return S_OK;
+            }
+        }
+        return setPathMode(fullpath, mode);
+    };
+
+    HRESULT BatchFileOstream::Impl::setAttr(const wchar_t* path, UInt32 attr) {
+        UString fullpath = getFullPath(path);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            CBatchItem* item = getItem(fullpath, lock);
+            if (item) {
+                item->attr = attr;
+                item->hasAttr = true;
+                return S_OK;
+            }
+        }
+        return setPathAttr(fullpath, attr);
+    };
+
+    HRESULT BatchFileOstream::Impl::setTime(const wchar_t* path, UInt32 time) {
+        UString fullpath = getFullPath(path);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            CBatchItem* item = getItem(fullpath, lock);
+            if (item) {
+                item->time = time;
+                item->hasTime = true;
+                return S_OK;
+            }
+        }
+        return setPathTime(fullpath, time);
+    };
+
+    // NOTE: the queued items are not written yet, the check is made before the extraction
+    HRESULT BatchFileOstream::Impl::stat(const wchar_t* path, UInt64& size, UInt32& time) {
+        return statOutputFile(getFullPath(path), size, time);
+    };
+
+    HRESULT BatchFileOstream::Impl::getCrc(const wchar_t* path, UInt32& crc) {
+        return getFileCrc(getFullPath(path), crc);
+    };
+
+    HRESULT BatchFileOstream::Impl::flush() {
+        submit();
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return queued == 0 && running.IsEmpty(); });
+        HRESULT hr = result;
+        result = S_OK;
+        errorPath = resultPath;
+        resultPath.Empty();
+        return hr;
+    };
+
+    const wchar_t* BatchFileOstream::Impl::getErrorPath() const {
+        return errorPath;
+    };
+
+    bool BatchFileOstream::Impl::isUring() const {
+        return uring != nullptr;
+    };
+
+    // wrappers
+
+    FileIstream::FileIstream(UInt32 blockSize) : pimpl(new Impl(blockSize)) {};
+
+    FileIstream::~FileIstream() {
+        delete pimpl;
+    };
+
+    HRESULT FileIstream::Open(const wchar_t* filename) {
+        return pimpl->open(filename);
+    };
+
+    void FileIstream::Close() {
+        pimpl->close();
+    };
+
+    HRESULT FileIstream::Read(void* data, UInt32 size, UInt32& processed) {
+        return pimpl->read(data, size, processed);
+    };
+
+    HRESULT FileIstream::Seek(Int64 offset, UInt32 origin, UInt64& position) {
+        return pimpl->seek(offset, origin, position);
+    };
+
+    UInt64 FileIstream::GetSize(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->size : 0;
+    };
+
+    bool FileIstream::IsDir(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->isDir : false;
+    };
+
+    UInt32 FileIstream::GetMode(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->mode : 0;
+    };
+
+    UInt32 FileIstream::GetAttr(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->attr : 0;
+    };
+
+    UInt32 FileIstream::GetTime(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->time : 0;
+    };
+
+    Istream* FileIstream::Clone() const {
+        FileIstream* clone = new FileIstream(pimpl->blockSize);
+        clone->pimpl->share(pimpl);
+        return clone;
+    };
+
+    HRESULT FileIstream::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) {
+        return pimpl->readAt(offset, data, size, processed);
+    };
+
+    HRESULT FileIstream::Advise(UInt64 offset, UInt64 size, int advice) {
+        return pimpl->advise(offset, size, advice);
+    };
+
+    MmapIstream::MmapIstream() : pimpl(new Impl()) {};
+
+    MmapIstream::~MmapIstream() {
+        delete pimpl;
+    };
+
+    HRESULT MmapIstream::Open(const wchar_t* filename) {
+        return pimpl->open(filename);
+    };
+
+    void MmapIstream::Close() {
+        pimpl->close();
+    };
+
+    HRESULT MmapIstream::Read(void* data, UInt32 size, UInt32& processed) {
+        return pimpl->read(data, size, processed);
+    };
+
+    HRESULT MmapIstream::Seek(Int64 offset, UInt32 origin, UInt64& position) {
+        return pimpl->seek(offset, origin, position);
+    };
+
+    UInt64 MmapIstream::GetSize(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->size : 0;
+    };
+
+    bool MmapIstream::IsDir(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->isDir : false;
+    };
+
+    UInt32 MmapIstream::GetMode(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->mode : 0;
+    };
+
+    UInt32 MmapIstream::GetAttr(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->attr : 0;
+    };
+
+    UInt32 MmapIstream::GetTime(const wchar_t* filename) {
+        const CFileStat* stat = pimpl->getStat(filename);
+        return stat ? stat->time : 0;
+    };
+
+    Istream* MmapIstream::Clone() const {
+        MmapIstream* clone = new MmapIstream();
+        clone->pimpl->share(pimpl);
+        return clone;
+    };
+
+    HRESULT MmapIstream::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32& processed) {
+        return pimpl->readAt(offset, data, size, processed);
+    };
+
+    HRESULT MmapIstream::Advise(UInt64 offset, UInt64 size, int advice) {
+        return pimpl->advise(offset, size, advice);
+    };
+
+    bool MmapIstream::IsMapped() const {
+        return pimpl->isMapped();
+    };
+
+    FileOstream::FileOstream(const wchar_t* basepath) : pimpl(new Impl(basepath)) {};
+
+    FileOstream::~FileOstream() {
+        delete pimpl;
+    };
+
+    HRESULT FileOstream::Open(const wchar_t* filename) {
+        return pimpl->open(filename);
+    };
+
+    void FileOstream::Close() {
+        pimpl->close();
+    };
+
+    HRESULT FileOstream::Write(const void* data, UInt32 size, UInt32& processed) {
+        return pimpl->write(data, size, processed);
+    };
+
+    HRESULT FileOstream::Seek(Int64 offset, UInt32 origin, UInt64& position) {
+        return pimpl->seek(offset, origin, position);
+    };
+
+    HRESULT FileOstream::SetSize(UInt64 size) {
+        return pimpl->setSize(size);
+    };
+
+    HRESULT FileOstream::Reserve(UInt64 size) {
+        return pimpl->reserve(size);
+    };
+
+    HRESULT FileOstream::Mkdir(const wchar_t* dirname) {
+        return pimpl->mkdir(dirname);
+    };
+
+    HRESULT FileOstream::SetMode(const wchar_t* path, UInt32 mode) {
+        return pimpl->setMode(path, mode);
+    };
+
+    HRESULT FileOstream::SetAttr(const wchar_t* path, UInt32 attr) {
+        return pimpl->setAttr(path, attr);
+    };
+
+    HRESULT FileOstream::SetTime(const wchar_t* path, UInt32 time) {
+        return pimpl->setTime(path, time);
+    };
+
+    HRESULT FileOstream::Stat(const wchar_t* path, UInt64& size, UInt32& time) {
+        return pimpl->stat(path, size, time);
+    };
+
+    HRESULT FileOstream::GetCrc(const wchar_t* path, UInt32& crc) {
+        return pimpl->getCrc(path, crc);
+    };
+
+    HRESULT FileOstream::WriteFrom(Istream& istream, UInt64 offset, UInt64 size, UInt64& processed) {
+        return pimpl->writeFrom(CFileSource::Get(istream), offset, size, processed);
+    };
+
+    DirectoryOstream::DirectoryOstream(const wchar_t* basepath) : pimpl(new Impl(basepath)) {};
+
+    DirectoryOstream::~DirectoryOstream() {
+        delete pimpl;
+    };
+
+    HRESULT DirectoryOstream::Open(const wchar_t* filename) {
+        return pimpl->open(filename);
+    };
+
+    void DirectoryOstream::Close() {
+        pimpl->close();
+    };
+
+    HRESULT DirectoryOstream::Write(const void* data, UInt32 size, UInt32& processed) {
+        return pimpl->write(data, size, processed);
+    };
+
+    HRESULT DirectoryOstream::Seek(Int64 offset, UInt32 origin, UInt64& position) {
+        return pimpl->seek(offset, origin, position);
+    };
+
+    HRESULT DirectoryOstream::SetSize(UInt64 size) {
+        return pimpl->setSize(size);
+    };
+
+    HRESULT DirectoryOstream::Reserve(UInt64 size) {
+        return pimpl->reserve(size);
+    };
+
+    HRESULT DirectoryOstream::Mkdir(const wchar_t* dirname) {
+        return pimpl->mkdir(dirname);
+    };
+
+    HRESULT DirectoryOstream::SetMode(const wchar_t* path, UInt32 mode) {
+        return pimpl->setMode(path, mode);
+    };
+
+    HRESULT DirectoryOstream::SetAttr(const wchar_t* path, UInt32 attr) {
+        return pimpl->setAttr(path, attr);
+    };
+
+    HRESULT DirectoryOstream::SetTime(const wchar_t* path, UInt32 time) {
+        return pimpl->setTime(path, time);
+    };
+
+    HRESULT DirectoryOstream::Stat(const wchar_t* path, UInt64& size, UInt32& time) {
+        return pimpl->stat(path, size, time);
+    };
+
+    HRESULT DirectoryOstream::GetCrc(const wchar_t* path, UInt32& crc) {
+        return pimpl->getCrc(path, crc);
+    };
+
+    HRESULT DirectoryOstream::WriteFrom(Istream& istream, UInt64 offset, UInt64 size, UInt64& processed) {
+        return pimpl->writeFrom(CFileSource::Get(istream), offset, size, processed);
+    };
+
+    BatchFileOstream::BatchFileOstream(const wchar_t* basepath, int numThreads, UInt32 queueDepth, UInt32 itemSizeMax, bool ioUring) :
+            pimpl(new Impl(basepath, numThreads, queueDepth, itemSizeMax, ioUring)) {};
+
+    BatchFileOstream::~BatchFileOstream() {
+        delete pimpl;
+    };
+
+    HRESULT BatchFileOstream::Open(const wchar_t* filename) {
+        return pimpl->open(filename);
+    };
+
+    void BatchFileOstream::Close() {
+        pimpl->close();
+    };
+
+    HRESULT BatchFileOstream::Write(const void* data, UInt32 size, UInt32& processed) {
+        return pimpl->write(data, size, processed);
+    };
+
+    HRESULT BatchFileOstream::Reserve(UInt64 size) {
+        return pimpl->reserve(size);
+    };
+
+    HRESULT BatchFileOstream::Mkdir(const wchar_t* dirname) {
+        return pimpl->mkdir(dirname);
+    };
+
+    HRESULT BatchFileOstream::SetMode(const wchar_t* path, UInt32 mode) {
+        return pimpl->setMode(path, mode);
+    };
+
+    HRESULT BatchFileOstream::SetAttr(const wchar_t* path, UInt32 attr) {
+        return pimpl->setAttr(path, attr);
+    };
+
+    HRESULT BatchFileOstream::SetTime(const wchar_t* path, UInt32 time) {
+        return pimpl->setTime(path, time);
+    };
+
+    HRESULT BatchFileOstream::Stat(const wchar_t* path, UInt64& size, UInt32& time) {
+        return pimpl->stat(path, size, time);
+    };
+
+    HRESULT BatchFileOstream::GetCrc(const wchar_t* path, UInt32& crc) {
+        return pimpl->getCrc(path, crc);
+    };
+
+    HRESULT BatchFileOstream::Flush() {
+        return pimpl->flush();
+    };
+
+    const wchar_t* BatchFileOstream::GetErrorPath() const {
+        return pimpl->getErrorPath();
+    };
+
+    bool BatchFileOstream::IsUring() const {
+        return pimpl->isUring();
+    };
+}
@@ -9,9 +9,16 @@
 #include "CPP/Windows/TimeUtils.h"
 #include "CPP/Windows/ErrorMsg.h"
 
+#include <cwctype>
+#include <thread>
+#include <vector>
+
 #ifndef _WIN32
 #include <dlfcn.h>
 #endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 #ifdef DEBUG_IMPL
 #   include <iostream>
@@ -25,6 +32,9 @@
 #ifndef max
 #define max(_a_,_b_) (((_a_) > (_b_)) ? (_a_) : (_b_))
 #endif
+#ifndef min
+#define min(_a_,_b_) (((_a_) < (_b_)) ? (_a_) : (_b_))
+#endif
 
 namespace sevenzip {
 
@@ -75,6 +85,123 @@ namespace sevenzip {
         return ((MY_VER_MAJOR << 16) | MY_VER_MINOR);
     };
 
+#ifdef __linux__
+    // NOTE: cpu.max is "max <period>" or "<quota> <period>", the lowest limit of the cgroup and its parents is taken
+    static int getCgroupQuota(const std::string& path, int limit) {
+        FILE* file = fopen((path + "/cpu.max").c_str(), "r");
+        if (file) {
+            char quota[32] = {};
+            unsigned long long period = 0;
+            if (fscanf(file, "%31s %llu", quota, &period) == 2 && period > 0 && strcmp(quota, "max") != 0) {
+                unsigned long long n = (strtoull(quota, nullptr, 10) + period - 1) / period;
+                if (n > 0 && (limit == 0 || n < (unsigned long long)limit))
+                    limit = (int)n;
+            }
+            fclose(file);
+        }
+        size_t separ = path.rfind('/');
+        if (separ == std::string::npos || separ < sizeof("/sys/fs/cgroup") - 1)
+            return limit;
+        return getCgroupQuota(path.substr(0, separ), limit);
+    };
+
+    static long long readCgroupValue(const std::string& path) {
+        long long value = -1;
+        FILE* file = fopen(path.c_str(), "r");
+        if (file) {
+            if (fscanf(file, "%lld", &value) != 1)
+                value = -1;
+            fclose(file);
+        }
+        return value;
+    };
+
+    // NOTE: cpu.cfs_quota_us is -1 when not limited, the lowest limit of the cgroup and its parents
+    // up to the mount point is taken
+    static int getCgroupV1Quota(const std::string& root, const std::string& group, int limit) {
+        long long quota = readCgroupValue(root + group + "/cpu.cfs_quota_us");
+        long long period = readCgroupValue(root + group + "/cpu.cfs_period_us");
+        if (quota > 0 && period > 0) {
+            int n = (int)((quota + period - 1) / period);
+            if (limit == 0 || n < limit)
+                limit = n;
+        }
+        size_t separ = group.rfind('/');
+        if (group.empty() || separ == std::string::npos)
+            return limit;
+        return getCgroupV1Quota(root, group.substr(0, separ), limit);
+    };
+
+    // NOTE: cgroup v2 path is taken from the "0::" line, v1 path from the line of the cpu controller,
+    // mounted by the name of its controllers or as "cpu"
+    static int getCgroupQuota() {
+        std::string path = "/sys/fs/cgroup";
+        std::string v1root;
+        std::string v1group;
+        FILE* file = fopen("/proc/self/cgroup", "r");
+        if (file) {
+            char line[4096];
+            while (fgets(line, sizeof(line), file)) {
+                std::string group(line);
+                while (!group.empty() && (group.back() == '\n' || group.back() == '/'))
+                    group.pop_back();
+                size_t first = group.find(':');
+                size_t second = first == std::string::npos ? first : group.find(':', first + 1);
+                if (second == std::string::npos)
+                    continue;
+                std::string controllers = group.substr(first + 1, second - first - 1);
+                group.erase(0, second + 1);
+                if (strncmp(line, "0::/", 4) == 0) {
+                    path += group;
+                    continue;
+                }
+                std::string list = "," + controllers + ",";
+                if (v1root.empty() && list.find(",cpu,") != std::string::npos) {
+                    v1root = "/sys/fs/cgroup/" + controllers;
+                    v1group = group;
+                }
+            }
+            fclose(file);
+        }
+        int limit = getCgroupQuota(path, 0);
+        if (limit > 0)
+            return limit;
+        if (v1root.empty() || readCgroupValue(v1root + "/cpu.cfs_period_us") < 0)
+            v1root = "/sys/fs/cgroup/cpu";
+        return getCgroupV1Quota(v1root, v1group, 0);
+    };
+#endif
+
+    // NOTE: the processors of the affinity mask, limited by the cgroup CPU quota rounded up
+    static int detectNumberOfThreads() {
+        int n = (int)std::thread::hardware_concurrency();
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+            n = CPU_COUNT(&set);
+        int quota = getCgroupQuota();
+        if (quota > 0 && quota < n)
+            n = quota;
+#endif
+        DEBUGLOG("detectNumberOfThreads " << n);
+        return n > 0 ? n : 1;
+    };
+
+    static std::atomic<int> numberOfThreads{0};
+
+    int getNumberOfThreads() {
+        int n = numberOfThreads.load(std::memory_order_relaxed);
+        if (n > 0)
+            return n;
+        static const int detected = detectNumberOfThreads();
+        return detected;
+    };
+
+    void setNumberOfThreads(int numThreads) {
+        numberOfThreads.store(numThreads > 0 ? numThreads : 0, std::memory_order_relaxed);
+    };
+
     wchar_t *fromBytes(const char* str) {
         static wchar_t buffer[1024];
         return fromBytes(buffer, sizeof(buffer)/sizeof(buffer[0]), str);
@@ -198,6 +325,18 @@ namespace sevenzip {
         return getWideValue(prop, propValue);
     };
 
+    static HRESULT getArchiveSizeItemProperty(IInArchive* archive, int index, PROPID propId, UInt64& propValue) {
+        NWindows::NCOM::CPropVariant prop;
+        HRESULT hr = archive->GetProperty(index, propId, &prop);
+        if (hr != S_OK)
+            return hr;
+        if (prop.vt == VT_UI4 || prop.vt == VT_I4) {
+            propValue = prop.ulVal;
+            return S_OK;
+        }
+        return getWideValue(prop, propValue);
+    };
+
     static HRESULT getArchiveTimeItemProperty(IInArchive* archive, int index, PROPID propId, UInt32& propValue) {
         NWindows::NCOM::CPropVariant prop;
         HRESULT hr = archive->GetProperty(index, propId, &prop);
@@ -206,6 +345,14 @@ namespace sevenzip {
         return getTimeValue(prop, propValue);
     };
 
+    static UInt32 getModeFromAttr(UInt32 attr) {
+        return (attr & 0x8000) ? attr >> 16 : 0; // p7zip posix feature
+    };
+
+    static UInt32 getAttrFromAttr(UInt32 attr) {
+        return (attr & 0x8000) ? attr & 0x7FFF : attr;
+    };
+
     static HRESULT setProperty(IOutArchive* archive, const wchar_t* name, NWindows::NCOM::CPropVariant prop) {
         CMyComPtr<ISetProperties> setter;
         HRESULT hr = archive->QueryInterface(IID_ISetProperties, (void **)&setter);
@@ -214,14 +361,122 @@ namespace sevenzip {
         return hr;
     };
 
+    // handler properties
+
+    HRESULT CHandlerProperties::Set(const wchar_t* name, const NWindows::NCOM::CPropVariant& prop) {
+        if (!name)
+            return S_FALSE;
+        for (unsigned i = 0; i < names.Size(); i++) {
+            if (names[i] == name) {
+                values[i] = prop;
+                return S_OK;
+            }
+        }
+        names.Add(UString(name));
+        values.Add(prop);
+        return S_OK;
+    };
+
+    bool CHandlerProperties::Has(const wchar_t* name) const {
+        for (unsigned i = 0; i < names.Size(); i++)
+            if (names[i] == name)
+                return true;
+        return false;
+    };
+
+    // NOTE: the values are shallow copies owned by the properties
+    HRESULT CHandlerProperties::Apply(IUnknown* handler, UInt32 threads, UInt32& used) const {
+        used = 0;
+        bool addThreads = threads > 0 && !Has(L"mt");
+        if (names.IsEmpty() && !addThreads)
+            return S_OK;
+        CMyComPtr<ISetProperties> setter;
+        handler->QueryInterface(IID_ISetProperties, (void **)&setter);
+        if (!setter)
+            return S_OK;
+
+        CRecordVector<const wchar_t*> setNames;
+        CRecordVector<PROPVARIANT> setValues;
+        for (unsigned i = 0; i < names.Size(); i++) {
+            setNames.Add(names[i].Ptr());
+            setValues.Add(values[i]);
+            if (wcscmp(names[i], L"mt") == 0 && values[i].vt == VT_UI4)
+                used = values[i].ulVal;
+        }
+        NWindows::NCOM::CPropVariant mt = threads;
+        if (addThreads) {
+            setNames.Add(L"mt");
+            setValues.Add(mt);
+        }
+        HRESULT hr = setter->SetProperties(&setNames[0], &setValues[0], setNames.Size());
+        if (addThreads && hr == S_OK)
+            used = threads;
+        if (addThreads && hr != S_OK) {
+            setNames.DeleteBack();
+            setValues.DeleteBack();
+            hr = setNames.IsEmpty() ? S_OK : setter->SetProperties(&setNames[0], &setValues[0], setNames.Size());
+        }
+        return hr;
+    };
+
     // streams
 
-    CInStream::CInStream(Istream* istream, bool cloned): istream(istream), cloned(cloned) {
-        DEBUGLOG(this << " CInStream " << istream << " " << cloned);
+    void CStreamStats::Get(Stats& stats) const {
+        stats.reads = reads.load(std::memory_order_relaxed);
+        stats.readBytes = readBytes.load(std::memory_order_relaxed);
+        stats.writes = writes.load(std::memory_order_relaxed);
+        stats.writeBytes = writeBytes.load(std::memory_order_relaxed);
+        stats.seeks = seeks.load(std::memory_order_relaxed);
+        stats.seeksElided = seeksElided.load(std::memory_order_relaxed);
+        stats.readAheadHits = readAheadHits.load(std::memory_order_relaxed);
+        stats.readAheadMisses = readAheadMisses.load(std::memory_order_relaxed);
+        stats.skips = skips.load(std::memory_order_relaxed);
+        stats.skipBytes = skipBytes.load(std::memory_order_relaxed);
+        stats.copies = copies.load(std::memory_order_relaxed);
+        stats.copyBytes = copyBytes.load(std::memory_order_relaxed);
+        stats.threads = threads.load(std::memory_order_relaxed);
+    };
+
+    void CStreamStats::Add(const CStreamStats& other) {
+        reads.fetch_add(other.reads.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        readBytes.fetch_add(other.readBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        writes.fetch_add(other.writes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        writeBytes.fetch_add(other.writeBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        seeks.fetch_add(other.seeks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        seeksElided.fetch_add(other.seeksElided.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        readAheadHits.fetch_add(other.readAheadHits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        readAheadMisses.fetch_add(other.readAheadMisses.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        skips.fetch_add(other.skips.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        skipBytes.fetch_add(other.skipBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        copies.fetch_add(other.copies.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        copyBytes.fetch_add(other.copyBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    };
+
+    void CStreamStats::Reset() {
+        reads.store(0, std::memory_order_relaxed);
+        readBytes.store(0, std::memory_order_relaxed);
+        writes.store(0, std::memory_order_relaxed);
+        writeBytes.store(0, std::memory_order_relaxed);
+        seeks.store(0, std::memory_order_relaxed);
+        seeksElided.store(0, std::memory_order_relaxed);
+        readAheadHits.store(0, std::memory_order_relaxed);
+        readAheadMisses.store(0, std::memory_order_relaxed);
+        skips.store(0, std::memory_order_relaxed);
+        skipBytes.store(0, std::memory_order_relaxed);
+        copies.store(0, std::memory_order_relaxed);
+        copyBytes.store(0, std::memory_order_relaxed);
+    };
+
+#define STATS_ADD(_s_,_c_,_n_) ((_s_) ? (void)(_s_)->_c_.fetch_add((_n_), std::memory_order_relaxed) : (void)0)
+
+    CInStream::CInStream(Istream* istream, bool cloned, UInt64 base, CStreamStats* stats):
+            istream(istream), cloned(cloned), base(base), stats(stats) {
+        DEBUGLOG(this << " CInStream " << istream << " " << cloned << " " << base);
     };
 
     CInStream::~CInStream() {
         DEBUGLOG(this << " ~CInStream");
+        delete readahead;
         if (cloned && istream)
             delete istream;
     };
@@ -229,25 +484,361 @@ namespace sevenzip {
     STDMETHODIMP CInStream::Read(void* data, UInt32 size, UInt32* processedSize) throw() {
         DEBUGLOG(this << " CInStream::Read " << size);
         UInt32 dummy = 0;
-        return istream ? istream->Read(data, size, processedSize ? *processedSize : dummy) : S_FALSE;
+        if (!istream)
+            return S_FALSE;
+        UInt32& processed = processedSize ? *processedSize : dummy;
+        processed = 0;
+        if (known || readahead || positional > 0)
+            advise(position, size);
+        HRESULT hr;
+        if (readahead) {
+            hr = readahead->Read(position, data, size, processed);
+        } else if (IsPositional()) {
+            hr = ReadRaw(position, data, size, processed);
+        } else {
+            hr = istream->Read(data, size, processed);
+            if (hr != S_OK)
+                known = false;
+            STATS_ADD(stats, reads, 1);
+            STATS_ADD(stats, readBytes, processed);
+        }
+        position += processed;
+        return hr;
     };
 
     STDMETHODIMP CInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) throw() {
         DEBUGLOG(this << " CInStream::Seek " << offset << "/" << seekOrigin);
         UInt64 dummy = 0;
-        return istream ? istream->Seek(offset, seekOrigin, newPosition ? *newPosition : dummy) : S_FALSE;
+        if (!istream)
+            return S_FALSE;
+        if (readahead || IsPositional()) {
+            UInt64 start = position;
+            if (seekOrigin == SZ_SEEK_SET) {
+                start = 0;
+            } else if (seekOrigin == SZ_SEEK_END) {
+                HRESULT hr = GetEnd(start);
+                if (hr != S_OK)
+                    return hr;
+            } else if (seekOrigin != SZ_SEEK_CUR) {
+                return E_INVALIDARG;
+            }
+            if (offset < 0 && (UInt64)(-offset) > start)
+                return E_INVALIDARG;
+            position = start + offset;
+            if (newPosition)
+                *newPosition = position;
+            STATS_ADD(stats, seeksElided, 1);
+            return S_OK;
+        }
+        // NOTE: relative seeks are made absolute when the position or the end is known,
+        // the seeks to the current position and the position queries are answered here
+        Int64 origOffset = offset;
+        UInt32 origOrigin = seekOrigin;
+        if (seekOrigin == SZ_SEEK_CUR && known) {
+            offset += (Int64)position;
+            seekOrigin = SZ_SEEK_SET;
+        } else if (seekOrigin == SZ_SEEK_END && ended) {
+            offset += (Int64)end;
+            seekOrigin = SZ_SEEK_SET;
+        }
+        if (seekOrigin == SZ_SEEK_SET && known && offset >= 0 && (UInt64)offset == position) {
+            if (newPosition)
+                *newPosition = position;
+            STATS_ADD(stats, seeksElided, 1);
+            return S_OK;
+        }
+        STATS_ADD(stats, seeks, 1);
+        known = false;
+        if (seekOrigin == SZ_SEEK_SET)
+            offset += (Int64)base;
+        UInt64 newpos = 0;
+        HRESULT hr = istream->Seek(offset, seekOrigin, newpos);
+        if (hr != S_OK)
+            return hr;
+        if (newpos < base) {
+            istream->Seek((Int64)base, SZ_SEEK_SET, dummy);
+            return E_INVALIDARG;
+        }
+        position = newpos - base;
+        known = true;
+        if (origOrigin == SZ_SEEK_END && !ended && (origOffset <= 0 || (UInt64)origOffset <= position)) {
+            end = position - origOffset;
+            ended = true;
+        }
+        if (newPosition)
+            *newPosition = position;
+        return S_OK;
     };
 
     HRESULT CInStream::Open(const wchar_t* path) {
         DEBUGLOG(this << " CInStream::Open " << path);
+        if (readahead)
+            readahead->Reset();
+        position = 0;
+        known = false;
+        ended = false;
+        pattern = ADVICE_NORMAL;
+        streak = 0;
+        lastEnd = 0;
         return istream ? istream->Open(path) : S_FALSE;
     };
 
+    // NOTE: probed once with an empty read, only E_NOTIMPL means no positional reads
+    bool CInStream::IsPositional() {
+        if (positional < 0) {
+            Byte dummy = 0;
+            UInt32 processed = 0;
+            positional = istream && istream->ReadAt(base, &dummy, 0, processed) != E_NOTIMPL ? 1 : 0;
+            DEBUGLOG(this << " CInStream::IsPositional " << positional);
+        }
+        return positional > 0;
+    };
+
+    // NOTE: the stream end is taken once, it moves the position of the stream
+    HRESULT CInStream::GetEnd(UInt64& end) {
+        std::lock_guard<std::mutex> lock(rawMutex);
+        if (!ended) {
+            UInt64 size = 0;
+            HRESULT hr = istream ? istream->Seek(0, SZ_SEEK_END, size) : S_FALSE;
+            STATS_ADD(stats, seeks, 1);
+            known = false;
+            if (hr != S_OK)
+                return hr;
+            if (size < base)
+                return E_FAIL;
+            this->end = size - base;
+            ended = true;
+        }
+        end = this->end;
+        return S_OK;
+    };
+
+    void CInStream::Share(const CInStream& parent) {
+        positional = parent.positional;
+        end = parent.end;
+        ended = parent.ended;
+        position = 0;
+    };
+
     void CInStream::Close() {
         DEBUGLOG(this << " CInStream::Close");
+        if (readahead)
+            readahead->Reset();
         if (istream) istream->Close();
     };
 
+    static const UInt64 kAdviseWindow = (UInt64)1 << 23;
+
+    // NOTE: two sequential reads switch to the sequential pattern, the window ahead is
+    // requested and the window behind is released; a seek away switches to the random one
+    void CInStream::advise(UInt64 position, UInt32 size) {
+        if (!advisable)
+            return;
+        if (position == lastEnd) {
+            if (streak < 2)
+                streak++;
+        } else {
+            streak = 0;
+        }
+        lastEnd = position + size;
+        int next = streak >= 2 ? ADVICE_SEQUENTIAL
+                : streak == 0 && pattern == ADVICE_SEQUENTIAL ? ADVICE_RANDOM
+                : pattern;
+        HRESULT hr = S_OK;
+        if (next != pattern) {
+            pattern = next;
+            hr = istream->Advise(base, 0, pattern);
+            willneedEnd = position;
+            dontneedStart = position;
+        }
+        if (hr == S_OK && pattern == ADVICE_SEQUENTIAL) {
+            if (lastEnd + kAdviseWindow / 2 > willneedEnd) {
+                UInt64 start = max(position, willneedEnd);
+                willneedEnd = position + kAdviseWindow;
+                hr = istream->Advise(base + start, willneedEnd - start, ADVICE_WILLNEED);
+            }
+            if (hr == S_OK && position >= dontneedStart + kAdviseWindow) {
+                hr = istream->Advise(base + dontneedStart, position - dontneedStart, ADVICE_DONTNEED);
+                dontneedStart = position;
+            }
+        }
+        if (hr == E_NOTIMPL)
+            advisable = false;
+    };
+
+    void CInStream::SetReadAhead(UInt32 numBlocks, UInt32 blockSize) {
+        DEBUGLOG(this << " CInStream::SetReadAhead " << numBlocks << " " << blockSize);
+        delete readahead;
+        readahead = nullptr;
+        if (!istream || numBlocks == 0)
+            return;
+        IsPositional();
+        readahead = new CReadAhead(this, numBlocks, blockSize, stats);
+    };
+
+    HRESULT CInStream::ReadRaw(UInt64 position, void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        HRESULT hr;
+        if (positional > 0) {
+            hr = istream->ReadAt(base + position, data, size, processed);
+        } else {
+            std::lock_guard<std::mutex> lock(rawMutex);
+            if (!known || cursor != position) {
+                STATS_ADD(stats, seeks, 1);
+                known = false;
+                UInt64 newpos = 0;
+                hr = istream->Seek((Int64)(base + position), SZ_SEEK_SET, newpos);
+                if (hr != S_OK)
+                    return hr;
+                cursor = position;
+                known = true;
+            }
+            hr = istream->Read(data, size, processed);
+            cursor += processed;
+            if (hr != S_OK)
+                known = false;
+        }
+        STATS_ADD(stats, reads, 1);
+        STATS_ADD(stats, readBytes, processed);
+        return hr;
+    };
+
+    // read-ahead
+
+    static const UInt32 kReadAheadBlockSize = (UInt32)1 << 20;
+    static const UInt32 kReadAheadBlockSizeMin = (UInt32)1 << 12;
+
+    CReadAhead::CReadAhead(CInStream* instream, UInt32 numBlocks, UInt32 blockSize, CStreamStats* stats) :
+            instream(instream),
+            stats(stats),
+            blockSize(blockSize == 0 ? kReadAheadBlockSize : max(blockSize, kReadAheadBlockSizeMin)) {
+        DEBUGLOG(this << " CReadAhead " << numBlocks << " " << this->blockSize);
+        blocks.ClearAndReserve(numBlocks);
+        for (UInt32 i = 0; i < numBlocks; i++)
+            blocks.Add(CReadAheadBlock());
+    };
+
+    CReadAhead::~CReadAhead() {
+        DEBUGLOG(this << " ~CReadAhead");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        if (thread.joinable())
+            thread.join();
+    };
+
+    // NOTE: waits for the block being loaded, the stream can be closed after this
+    void CReadAhead::Reset() {
+        std::unique_lock<std::mutex> lock(mutex);
+        active = false;
+        generation++;
+        filled = 0;
+        lastEnd = 0;
+        streak = 0;
+        cond.wait(lock, [this] { return !loading; });
+    };
+
+    // NOTE: called under the lock
+    void CReadAhead::restart(UInt64 position) {
+        start = position;
+        head = 0;
+        filled = 0;
+        eof = false;
+        active = true;
+        generation++;
+        if (!thread.joinable())
+            thread = std::thread(&CReadAhead::run, this);
+        cond.notify_all();
+    };
+
+    void CReadAhead::run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop) {
+            if (!active || eof || loading || filled >= blocks.Size()) {
+                cond.wait(lock);
+                continue;
+            }
+            unsigned index = (head + filled) % blocks.Size();
+            UInt64 offset = start + (UInt64)filled * blockSize;
+            unsigned loaded = generation;
+            CReadAheadBlock& block = blocks[index];
+            if (block.data.Size() != blockSize)
+                block.data.Alloc(blockSize);
+            loading = true;
+            lock.unlock();
+            UInt32 processed = 0;
+            HRESULT hr = instream->ReadRaw(offset, block.data, blockSize, processed);
+            lock.lock();
+            loading = false;
+            if (loaded == generation) {
+                block.size = processed;
+                block.result = hr;
+                filled++;
+                if (hr != S_OK || processed < blockSize)
+                    eof = true;
+            }
+            cond.notify_all();
+        }
+    };
+
+    // NOTE: the read is a hit if it starts in the window, the window slides while the blocks are consumed
+    HRESULT CReadAhead::Read(UInt64 position, void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        UInt64 window = (UInt64)blocks.Size() * blockSize;
+        if (active && position >= start && position < start + window) {
+            STATS_ADD(stats, readAheadHits, 1);
+            while (size > 0) {
+                if (filled == 0) {
+                    if (eof)
+                        break;
+                    cond.wait(lock);
+                    continue;
+                }
+                CReadAheadBlock& block = blocks[head];
+                if (block.result != S_OK) {
+                    HRESULT hr = block.result;
+                    active = false;
+                    generation++;
+                    filled = 0;
+                    return hr;
+                }
+                UInt64 skip = position - start;
+                if (skip >= block.size) {
+                    if (block.size < blockSize)
+                        break;
+                    head = (head + 1) % blocks.Size();
+                    filled--;
+                    start += blockSize;
+                    cond.notify_all();
+                    continue;
+                }
+                UInt32 n = (UInt32)min((UInt64)size, block.size - skip);
+                memcpy((Byte*)data + processed, (const Byte*)block.data + (size_t)skip, n);
+                position += n;
+                processed += n;
+                size -= n;
+            }
+            lastEnd = position;
+            return S_OK;
+        }
+
+        STATS_ADD(stats, readAheadMisses, 1);
+        streak = position == lastEnd ? streak + 1 : 0;
+        active = false;
+        generation++;
+        filled = 0;
+        lock.unlock();
+        HRESULT hr = instream->ReadRaw(position, data, size, processed);
+        lock.lock();
+        lastEnd = position + processed;
+        if (hr == S_OK && streak > 0 && processed == size)
+            restart(lastEnd);
+        return hr;
+    };
+
     bool CInStream::IsDir(const wchar_t* pathname) {
         DEBUGLOG(this << " CInStream::IsDir " << pathname);
         return istream ? istream->IsDir(pathname) : false;
@@ -274,33 +865,105 @@ namespace sevenzip {
         return istream ? istream->GetAttr(pathname) : 0;
     };
 
-    COutStream::COutStream(Ostream* ostream): ostream(ostream) {
+    COutStream::COutStream(Ostream* ostream, CStreamStats* stats): ostream(ostream), stats(stats) {
         DEBUGLOG(this << " COutStream");
     };
 
     COutStream::~COutStream() {
         DEBUGLOG(this << " ~COutStream");
+        delete writebehind;
     };
 
     STDMETHODIMP COutStream::Write(const void* data, UInt32 size, UInt32* processedSize) throw() {
         DEBUGLOG(this << " COutStream::Write " << size);
         UInt32 dummy = 0;
-        return ostream ? ostream->Write(data, size, processedSize ? *processedSize : dummy) : S_FALSE;
+        if (!ostream)
+            return S_FALSE;
+        UInt32& processed = processedSize ? *processedSize : dummy;
+        processed = 0;
+        HRESULT hr;
+        if (writebehind) {
+            hr = writebehind->Write(data, size);
+            processed = hr == S_OK ? size : 0;
+        } else {
+            hr = ostream->Write(data, size, processed);
+            STATS_ADD(stats, writes, 1);
+            STATS_ADD(stats, writeBytes, processed);
+        }
+        position += processed;
+        if (hr != S_OK)
+            known = false;
+        if (ended && !known)
+            ended = false;
+        else if (ended && position > end)
+            end = position;
+        return hr;
     };
 
+    // NOTE: same as CInStream::Seek, written data moves the known end
     STDMETHODIMP COutStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) throw() {
         DEBUGLOG(this << " COutStream::Seek " << offset << "/" << seekOrigin);
         UInt64 dummy = 0;
-        return ostream ? ostream->Seek(offset, seekOrigin, newPosition ? *newPosition : dummy) : S_FALSE;
+        if (!ostream)
+            return S_FALSE;
+        Int64 origOffset = offset;
+        UInt32 origOrigin = seekOrigin;
+        if (seekOrigin == SZ_SEEK_CUR && known) {
+            offset += (Int64)position;
+            seekOrigin = SZ_SEEK_SET;
+        } else if (seekOrigin == SZ_SEEK_END && ended) {
+            offset += (Int64)end;
+            seekOrigin = SZ_SEEK_SET;
+        }
+        if (seekOrigin == SZ_SEEK_SET && known && offset >= 0 && (UInt64)offset == position) {
+            if (newPosition)
+                *newPosition = position;
+            STATS_ADD(stats, seeksElided, 1);
+            return S_OK;
+        }
+        HRESULT hr = Flush();
+        if (hr != S_OK)
+            return hr;
+        STATS_ADD(stats, seeks, 1);
+        known = false;
+        hr = ostream->Seek(offset, seekOrigin, newPosition ? *newPosition : dummy);
+        if (hr != S_OK)
+            return hr;
+        position = newPosition ? *newPosition : dummy;
+        known = true;
+        if (origOrigin == SZ_SEEK_END && (origOffset <= 0 || (UInt64)origOffset <= position)) {
+            end = position - origOffset;
+            ended = true;
+        }
+        return S_OK;
     };
 
     STDMETHODIMP COutStream::SetSize(UInt64 size) throw() {
         DEBUGLOG(this << " COutStream::SetSize " << size);
-        return ostream ? ostream->SetSize(size) : S_FALSE;
+        if (!ostream)
+            return S_FALSE;
+        HRESULT hr = Flush();
+        if (hr != S_OK)
+            return hr;
+        hr = ostream->SetSize(size);
+        ended = hr == S_OK;
+        end = size;
+        return hr;
+    };
+
+    HRESULT COutStream::Reserve(UInt64 size) {
+        DEBUGLOG(this << " COutStream::Reserve " << size);
+        HRESULT hr = Flush();
+        if (hr != S_OK)
+            return hr;
+        return ostream ? ostream->Reserve(size) : S_FALSE;
     };
 
     HRESULT COutStream::Mkdir(const wchar_t* dirname) {
         DEBUGLOG(this << " COutStream::Mkdir " << dirname);
+        HRESULT hr = Flush();
+        if (hr != S_OK)
+            return hr;
         return ostream ? ostream->Mkdir(dirname) : S_FALSE;
     };
     
@@ -321,23 +984,188 @@ namespace sevenzip {
 
     HRESULT COutStream::Open(const wchar_t* filename) {
         DEBUGLOG(this << " COutStream::Open " << filename);
+        // NOTE: a write-behind error of the previous file is returned here rather than lost
+        HRESULT hr = Flush();
+        if (hr != S_OK)
+            return hr;
+        position = 0;
+        known = false;
+        ended = false;
         return ostream ? ostream->Open(filename) : S_FALSE;
     };
 
     void COutStream::Close() {
         DEBUGLOG(this << " COutStream::Close");
+        Flush();
         if (ostream) ostream->Close();
     };
 
+    void COutStream::SetWriteBehind(UInt32 numBuffers, UInt32 bufferSize) {
+        DEBUGLOG(this << " COutStream::SetWriteBehind " << numBuffers << " " << bufferSize);
+        Flush();
+        delete writebehind;
+        writebehind = nullptr;
+        if (ostream && numBuffers > 0)
+            writebehind = new CWriteBehind(ostream, numBuffers, bufferSize, stats);
+    };
+
+    HRESULT COutStream::Flush() {
+        return writebehind ? writebehind->Flush() : S_OK;
+    };
+
+    // write-behind
+
+    static const UInt32 kWriteBehindBufferSize = (UInt32)1 << 20;
+    static const UInt32 kWriteBehindBufferSizeMin = (UInt32)1 << 12;
+
+    CWriteBehind::CWriteBehind(Ostream* ostream, UInt32 numBuffers, UInt32 bufferSize, CStreamStats* stats) :
+            ostream(ostream),
+            stats(stats),
+            bufferSize(bufferSize == 0 ? kWriteBehindBufferSize : max(bufferSize, kWriteBehindBufferSizeMin)) {
+        DEBUGLOG(this << " CWriteBehind " << numBuffers << " " << this->bufferSize);
+        for (UInt32 i = 0; i < numBuffers; i++)
+            buffers.Add(CWriteBehindBuffer());
+    };
+
+    CWriteBehind::~CWriteBehind() {
+        DEBUGLOG(this << " ~CWriteBehind");
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        if (thread.joinable())
+            thread.join();
+    };
+
+    HRESULT CWriteBehind::writeBuffer(const CWriteBehindBuffer& buffer) {
+        UInt32 written = 0;
+        while (written < buffer.size) {
+            UInt32 processed = 0;
+            HRESULT hr = ostream->Write((const Byte*)buffer.data + written, buffer.size - written, processed);
+            STATS_ADD(stats, writes, 1);
+            STATS_ADD(stats, writeBytes, processed);
+            if (hr != S_OK)
+                return hr;
+            if (processed == 0)
+                return E_FAIL;
+            written += processed;
+        }
+        return S_OK;
+    };
+
+    void CWriteBehind::run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (queued == 0) {
+                if (stop)
+                    break;
+                cond.wait(lock);
+                continue;
+            }
+            CWriteBehindBuffer& buffer = buffers[head];
+            writing = true;
+            bool skip = result != S_OK;
+            lock.unlock();
+            HRESULT hr = skip ? S_OK : writeBuffer(buffer);
+            lock.lock();
+            writing = false;
+            if (hr != S_OK && result == S_OK)
+                result = hr;
+            buffer.size = 0;
+            head = (head + 1) % buffers.Size();
+            queued--;
+            cond.notify_all();
+        }
+    };
+
+    // NOTE: the data is copied into the buffer being filled outside of the lock,
+    // the thread writes the queued buffers only
+    HRESULT CWriteBehind::Write(const void* data, UInt32 size) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (size > 0) {
+            if (result != S_OK)
+                return result;
+            if (queued == buffers.Size()) {
+                cond.wait(lock);
+                continue;
+            }
+            CWriteBehindBuffer& buffer = buffers[(head + queued) % buffers.Size()];
+            lock.unlock();
+            if (buffer.data.Size() != bufferSize)
+                buffer.data.Alloc(bufferSize);
+            UInt32 n = min(size, bufferSize - buffer.size);
+            memcpy((Byte*)buffer.data + buffer.size, data, n);
+            buffer.size += n;
+            data = (const Byte*)data + n;
+            size -= n;
+            lock.lock();
+            if (buffer.size == bufferSize) {
+                queued++;
+                if (!thread.joinable())
+                    thread = std::thread(&CWriteBehind::run, this);
+                cond.notify_all();
+            }
+        }
+        return S_OK;
+    };
+
+    // NOTE: the last partial buffer is written here if the thread is not started yet
+    HRESULT CWriteBehind::Flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (queued < buffers.Size()) {
+            CWriteBehindBuffer& buffer = buffers[(head + queued) % buffers.Size()];
+            if (buffer.size > 0) {
+                if (!thread.joinable()) {
+                    if (result == S_OK)
+                        result = writeBuffer(buffer);
+                    buffer.size = 0;
+                } else {
+                    queued++;
+                    cond.notify_all();
+                }
+            }
+        }
+        cond.wait(lock, [this] { return queued == 0 && !writing; });
+        HRESULT hr = result;
+        result = S_OK;
+        return hr;
+    };
+
+    // buffer streams
+
+    STDMETHODIMP CBufferInStream::Read(void* data, UInt32 size, UInt32* processedSize) throw() {
+        UInt32 n = min(size, this->size - position);
+        if (n > 0)
+            memcpy(data, this->data + position, n);
+        position += n;
+        if (processedSize)
+            *processedSize = n;
+        return S_OK;
+    };
+
+    STDMETHODIMP CBufferOutStream::Write(const void* data, UInt32 size, UInt32* processedSize) throw() {
+        UInt32 n = min(size, this->size - position);
+        if (n > 0)
+            memcpy(this->data + position, data, n);
+        position += n;
+        if (processedSize)
+            *processedSize = n;
+        return n < size ? E_OUTOFMEMORY : S_OK;
+    };
+
     // callbacks
 
-    COpenCallback::COpenCallback(Istream* istream, const wchar_t* pathname, const wchar_t* password) :
+    COpenCallback::COpenCallback(Istream* istream, const wchar_t* pathname, const wchar_t* password,
+            CStreamStats* stats) :
         istream(istream),
         pathname(pathname ? pathname : L""),
         password(password ? password : L""),
         passworddefined(password),
         subarchivename(L""),
-        subarchivemode(false) {
+        subarchivemode(false),
+        stats(stats) {
         DEBUGLOG(this << " COpenCallback " << istream << " " << (password ? password : L"NULL"));
     };
 
@@ -392,7 +1220,7 @@ namespace sevenzip {
         if (!newIstream)
             return E_FAIL;
 
-        CMyComPtr<IInStream> instream(new CInStream(newIstream, true));
+        CMyComPtr<IInStream> instream(new CInStream(newIstream, true, 0, stats));
         *inStream = instream.Detach();
         pathname = name ? name : L"";
 
@@ -424,18 +1252,64 @@ namespace sevenzip {
     } 
 
 
-    CExtractCallback::CExtractCallback(Ostream* ostream, IInArchive* archive, const wchar_t* password) :
-            outstream(new COutStream(ostream)),
+    static HRESULT getOperationResult(Int32 operationResult) {
+        if (operationResult == NArchive::NExtract::NOperationResult::kOK)
+            return S_OK;
+        if (operationResult == NArchive::NExtract::NOperationResult::kWrongPassword)
+            return E_NEEDPASSWORD;
+        if (operationResult == NArchive::NExtract::NOperationResult::kUnsupportedMethod)
+            return E_NOTSUPPORTED;
+        return E_FAIL;
+    };
+
+    CExtractCallback::CExtractCallback(Ostream* ostream, IInArchive* archive, const wchar_t* password,
+            CStreamStats* stats) :
+            outstream(new COutStream(ostream, stats)),
             archive(archive),
             password(password ? password : L""),
             passworddefined(password != nullptr),
-            index(-1) {
+            index(-1),
+            factory(nullptr),
+            items(nullptr),
+            itemstream(nullptr),
+            stats(stats) {
         DEBUGLOG(this << " CExtractCallback::CExtractCallback " << archive << " "
                 << (password ? password : L"NULL"));
     };
 
+    CExtractCallback::CExtractCallback(OstreamFactory* factory, const CItemTable* items,
+            IInArchive* archive, const wchar_t* password, CStreamStats* stats) :
+            archive(archive),
+            password(password ? password : L""),
+            passworddefined(password != nullptr),
+            index(-1),
+            factory(factory),
+            items(items),
+            itemstream(nullptr),
+            stats(stats) {
+        DEBUGLOG(this << " CExtractCallback::CExtractCallback factory " << archive << " "
+                << (password ? password : L"NULL"));
+    };
+
+    // NOTE: the factory streams get the write-behind when created
+    void CExtractCallback::SetWriteBehind(UInt32 numBuffers, UInt32 bufferSize) {
+        writeBehindBuffers = numBuffers;
+        writeBehindBufferSize = bufferSize;
+        if (!factory && outstream)
+            COUTSTREAM(outstream)->SetWriteBehind(numBuffers, bufferSize);
+    };
+
+    void CExtractCallback::SetDeferredMetadata(const CItemTable* items, CRecordVector<UInt32>* metadata) {
+        if (!factory) {
+            this->items = items;
+            this->metadata = metadata;
+        }
+    };
+
     CExtractCallback::~CExtractCallback() {
         DEBUGLOG(this << " CExtractCallback::~CExtractCallback");
+        if (itemstream)
+            SetFactoryResult(E_ABORT);
     };
 
     STDMETHODIMP CExtractCallback::SetTotal(UInt64 UNUSED(size)) throw() {
@@ -451,24 +1325,36 @@ namespace sevenzip {
     STDMETHODIMP CExtractCallback::GetStream(UInt32 index, ISequentialOutStream** outStream, Int32 askExtractMode) throw() {
         DEBUGLOG(this << " CExtractCallback::GetStream " << index << " stream " << *outStream << " mode " << askExtractMode);
         *outStream = nullptr;
+        // NOTE: previous item was not finished by the handler
+        if (itemstream)
+            SetFactoryResult(E_ABORT);
         this->index = -1;
 
         if (askExtractMode != NArchive::NExtract::NAskMode::kExtract)
             return S_OK;
 
+        if (factory)
+            return GetFactoryStream(index, outStream);
+
         if (!outstream)
             return E_FAIL;
 
         HRESULT hr;
         UString pathname = kEmptyFileAlias;
-        hr = getArchiveStringItemProperty(archive, index, kpidPath, pathname);
-        if (FAILED(hr))
-            return hr;
-
         bool isdir = false;
-        hr = getArchiveBoolItemProperty(archive, index, kpidIsDir, isdir);
-        if (FAILED(hr))
-            return hr;
+        if (items && index < items->Size()) {
+            ItemInfo info;
+            items->Get(index, info);
+            pathname = info.path;
+            isdir = info.isDir;
+        } else {
+            hr = getArchiveStringItemProperty(archive, index, kpidPath, pathname);
+            if (FAILED(hr))
+                return hr;
+            hr = getArchiveBoolItemProperty(archive, index, kpidIsDir, isdir);
+            if (FAILED(hr))
+                return hr;
+        }
 
         this->index = index;
         if (isdir)
@@ -479,7 +1365,14 @@ namespace sevenzip {
 
         hr = COUTSTREAM(outstream)->Open(pathname);
         DEBUGLOG(this << " CExtractCallback::GetStream Open " << pathname.Ptr() << " hr " << hr);
-        return FAILED(hr) ? hr : S_OK;
+        if (FAILED(hr))
+            return hr;
+
+        // NOTE: preallocation is a hint, the sink errors are ignored
+        UInt64 size = 0;
+        if (getArchiveSizeItemProperty(archive, index, kpidSize, size) == S_OK && size > 0)
+            COUTSTREAM(outstream)->Reserve(size);
+        return S_OK;
     };
 
     STDMETHODIMP CExtractCallback::PrepareOperation(Int32 UNUSED(askExtractMode)) throw() {
@@ -489,8 +1382,19 @@ namespace sevenzip {
 
     STDMETHODIMP CExtractCallback::SetOperationResult(Int32 operationResult) throw() {
         DEBUGLOG(this << " CExtractCallback::SetOperationResult " << operationResult << " item " << index);
+        if (factory)
+            return SetFactoryResult(getOperationResult(operationResult));
+        // NOTE: the write-behind errors are reported here, the item is closed without metadata
+        HRESULT hr = outstream && index >= 0 ? COUTSTREAM(outstream)->Flush() : S_OK;
+        if (hr != S_OK) {
+            COUTSTREAM(outstream)->Close();
+            return hr;
+        }
         if (operationResult == NArchive::NExtract::NOperationResult::kOK) {
-            if (outstream && index >= 0) {
+            if (outstream && index >= 0 && metadata) {
+                COUTSTREAM(outstream)->Close();
+                metadata->Add((UInt32)index);
+            } else if (outstream && index >= 0) {
                 COUTSTREAM(outstream)->Close();
 
                 UString pathname = kEmptyFileAlias;
@@ -526,11 +1430,72 @@ namespace sevenzip {
             }
             return S_OK;
         }
-        if (operationResult == NArchive::NExtract::NOperationResult::kWrongPassword)
-            return E_NEEDPASSWORD;
-        if (operationResult == NArchive::NExtract::NOperationResult::kUnsupportedMethod)
-            return E_NOTSUPPORTED;
-        return E_FAIL;
+        return getOperationResult(operationResult);
+    };
+
+    // NOTE: the table keeps the attributes without the unix extension and the mode taken from it
+    static void setItemMetadata(Ostream* ostream, const ItemInfo& info) {
+        if (info.time != 0)
+            ostream->SetTime(info.path, info.time);
+        if (info.attr != 0)
+            ostream->SetAttr(info.path, info.attr);
+        if (info.mode != 0)
+            ostream->SetMode(info.path, info.mode);
+        else if (info.isDir)
+            ostream->SetMode(info.path, 0700);
+    };
+
+    // NOTE: the item is skipped if the factory does not create a stream for it
+    HRESULT CExtractCallback::GetFactoryStream(UInt32 index, ISequentialOutStream** outStream) {
+        if (!items || index >= items->Size())
+            return E_FAIL;
+
+        ItemInfo info;
+        items->Get(index, info);
+        itemstream = factory->Create((int)index, info);
+        DEBUGLOG(this << " CExtractCallback::GetFactoryStream " << info.path << " stream " << itemstream);
+        if (!itemstream)
+            return S_OK;
+
+        this->index = index;
+        HRESULT hr = info.isDir ? itemstream->Mkdir(info.path) : itemstream->Open(info.path);
+        if (FAILED(hr)) {
+            factory->Release((int)index, itemstream, hr);
+            itemstream = nullptr;
+            this->index = -1;
+            return hr;
+        }
+        if (!info.isDir) {
+            if (info.size > 0)
+                itemstream->Reserve(info.size);
+            outstream = new COutStream(itemstream, stats);
+            if (writeBehindBuffers > 0)
+                COUTSTREAM(outstream)->SetWriteBehind(writeBehindBuffers, writeBehindBufferSize);
+            *outStream = outstream;
+            outstream->AddRef();
+        }
+        return S_OK;
+    };
+
+    HRESULT CExtractCallback::SetFactoryResult(HRESULT result) {
+        if (itemstream && index >= 0) {
+            if (outstream) {
+                HRESULT hr = COUTSTREAM(outstream)->Flush();
+                if (result == S_OK)
+                    result = hr;
+            }
+            itemstream->Close();
+            if (result == S_OK) {
+                ItemInfo info;
+                items->Get(index, info);
+                setItemMetadata(itemstream, info);
+            }
+            outstream = nullptr;
+            factory->Release(index, itemstream, result);
+        }
+        itemstream = nullptr;
+        index = -1;
+        return result;
     };
 
     STDMETHODIMP CExtractCallback::CryptoGetTextPassword(BSTR* password) throw() {
@@ -542,8 +1507,8 @@ namespace sevenzip {
     };
 
 
-    CUpdateCallback::CUpdateCallback(Istream* istream, const wchar_t* password) :
-            instream(new CInStream(istream)),
+    CUpdateCallback::CUpdateCallback(Istream* istream, const wchar_t* password, CStreamStats* stats) :
+            instream(new CInStream(istream, false, 0, stats)),
             password(password ? password : L""),
             passworddefined(password != nullptr) {
         DEBUGLOG(this << " CUpdateCallback " << istream << " " << (password ? password : L"NULL"));
@@ -656,6 +1621,176 @@ namespace sevenzip {
         return StringToBstr(this->password, password);
     };
 
+    // item streams
+
+    CItemIstream::CItemIstream(ISequentialInStream* stream, UInt64 size) : stream(stream), size(size) {
+        DEBUGLOG(this << " CItemIstream " << size);
+        this->stream.QueryInterface(IID_IInStream, &seekable);
+    };
+
+    CItemIstream::~CItemIstream() {
+        DEBUGLOG(this << " ~CItemIstream");
+    };
+
+    HRESULT CItemIstream::Read(void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        return stream->Read(data, size, &processed);
+    };
+
+    HRESULT CItemIstream::Seek(Int64 offset, UInt32 origin, UInt64& position) {
+        if (!seekable)
+            return S_FALSE;
+        return seekable->Seek(offset, origin, &position);
+    };
+
+    UInt64 CItemIstream::GetSize(const wchar_t* /*filename*/) {
+        return size;
+    };
+
+    static const UInt32 kPipeBufferSize = (UInt32)1 << 20;
+    static const UInt32 kPipeBufferSizeMin = (UInt32)1 << 12;
+
+    CPipeIstream::CPipeIstream(UInt64 size, UInt32 bufferSize) :
+            buffer(bufferSize == 0 ? kPipeBufferSize : max(bufferSize, kPipeBufferSizeMin)),
+            size(size) {
+        DEBUGLOG(this << " CPipeIstream " << size << " " << buffer.Size());
+        writer.pipe = this;
+    };
+
+    CPipeIstream::~CPipeIstream() {
+        DEBUGLOG(this << " ~CPipeIstream");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+        }
+        cond.notify_all();
+        if (thread.joinable())
+            thread.join();
+    };
+
+    // NOTE: the handler is kept by the stream, the decoder uses it until the item is read or the stream deleted
+    HRESULT CPipeIstream::Start(IInArchive* archive, UInt32 index, const wchar_t* password, CStreamStats* stats) {
+        this->archive = archive;
+        this->index = index;
+        this->password = password ? password : L"";
+        this->passworddefined = password != nullptr;
+        this->stats = stats;
+        try {
+            thread = std::thread(&CPipeIstream::run, this);
+        } catch (...) {
+            return E_FAIL;
+        }
+        return S_OK;
+    };
+
+    void CPipeIstream::run() {
+        CExtractCallback* callback = new CExtractCallback(&writer, archive,
+                passworddefined ? password.Ptr() : nullptr, stats);
+        CMyComPtr<IArchiveExtractCallback> extractcallback = callback;
+        HRESULT hr = archive->Extract(&index, 1, false, extractcallback);
+        DEBUGLOG(this << " CPipeIstream::run " << index << " hr " << hr);
+        std::lock_guard<std::mutex> lock(mutex);
+        result = hr;
+        done = true;
+        cond.notify_all();
+    };
+
+    HRESULT CPipeIstream::write(const void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (processed < size) {
+            cond.wait(lock, [this]() { return used < buffer.Size() || cancelled; });
+            if (cancelled)
+                return E_ABORT;
+            size_t tail = (head + used) % buffer.Size();
+            size_t n = min(min(buffer.Size() - used, buffer.Size() - tail), (size_t)(size - processed));
+            memcpy((Byte*)buffer + tail, (const Byte*)data + processed, n);
+            used += n;
+            processed += (UInt32)n;
+            cond.notify_all();
+        }
+        return S_OK;
+    };
+
+    // NOTE: the end of the item is reported as a read of zero bytes, the decoder error when the data is read
+    HRESULT CPipeIstream::Read(void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]() { return used > 0 || done; });
+        if (used == 0)
+            return result;
+        size_t n = min(min(used, buffer.Size() - head), (size_t)size);
+        memcpy(data, (const Byte*)buffer + head, n);
+        head = (head + n) % buffer.Size();
+        used -= n;
+        processed = (UInt32)n;
+        cond.notify_all();
+        return S_OK;
+    };
+
+    UInt64 CPipeIstream::GetSize(const wchar_t* /*filename*/) {
+        return size;
+    };
+
+    HRESULT CPipeIstream::CWriter::Open(const wchar_t* /*filename*/) {
+        return S_OK;
+    };
+
+    HRESULT CPipeIstream::CWriter::Write(const void* data, UInt32 size, UInt32& processed) {
+        return pipe->write(data, size, processed);
+    };
+
+    // items table
+
+    void CItemTable::Clear() {
+        pathOffsets.Clear();
+        paths.Clear();
+        sizes.Clear();
+        packSizes.Clear();
+        times.Clear();
+        attrs.Clear();
+        modes.Clear();
+        crcs.Clear();
+        blocks.Clear();
+        flags.Clear();
+    };
+
+    void CItemTable::Get(unsigned index, ItemInfo& info) const {
+        info.path = &paths[pathOffsets[index]];
+        info.pathLength = pathOffsets[index + 1] - pathOffsets[index] - 1;
+        info.size = sizes[index];
+        info.packSize = packSizes[index];
+        info.time = times[index];
+        info.attr = attrs[index];
+        info.mode = modes[index];
+        info.crc = crcs[index];
+        info.block = blocks[index];
+        info.isDir = (flags[index] & kIsDir) != 0;
+        info.hasCrc = (flags[index] & kHasCrc) != 0;
+        info.hasBlock = (flags[index] & kHasBlock) != 0;
+    };
+
+    // blocks table
+
+    void CBlockTable::Clear() {
+        ids.Clear();
+        packSizes.Clear();
+        methodOffsets.Clear();
+        methods.Clear();
+        itemOffsets.Clear();
+        items.Clear();
+        itemEnds.Clear();
+        itemBlocks.Clear();
+    };
+
+    void CBlockTable::Get(unsigned index, BlockInfo& info) const {
+        info.block = ids[index];
+        info.numItems = itemOffsets[index + 1] - itemOffsets[index];
+        info.size = info.numItems > 0 ? itemEnds[itemOffsets[index + 1] - 1] : 0;
+        info.packSize = packSizes[index];
+        info.method = &methods[methodOffsets[index]];
+    };
+
     // archives
 
     Iarchive::Impl::Impl() {
@@ -667,12 +1802,14 @@ namespace sevenzip {
         close();
     };
 
+    // NOTE: the shared stream is already opened and read at the own position of the wrapper
     HRESULT Iarchive::Impl::open(Lib::Impl* libimpl, Istream* istream,
-            const wchar_t* filename, const wchar_t* password, int formatIndex) {
+            const wchar_t* filename, const wchar_t* password, int formatIndex, UInt64 offset,
+            const CInStream* shared) {
         DEBUGLOG(this << " Iarchive::open "
                 << (filename ? filename : L"NULL") << " "
                 << (password ? password : L"NULL") << " "
-                << formatIndex);
+                << formatIndex << " " << offset);
 
         if (!libimpl || !libimpl->CreateObjectFunc)
             return S_FALSE;
@@ -682,16 +1819,33 @@ namespace sevenzip {
 
         HRESULT hr = S_OK;
         UString name = filename ? filename : L"";
-        hr = istream->Open(name);
+        if (!shared)
+            hr = istream->Open(name);
         if (FAILED(hr))
             return hr;
         // NOTE: commented to allow preopen stream start at nonzero positions (not checked yet)
         // hr = istream->Seek(0, SZ_SEEK_SET, nullptr);
         // if (FAILED(hr))
         //     return hr;
+        if (offset > 0 && !shared) {
+            UInt64 position = 0;
+            hr = istream->Seek((Int64)offset, SZ_SEEK_SET, position);
+            if (hr != S_OK)
+                return FAILED(hr) ? hr : E_FAIL;
+        }
 
-        instream = new CInStream(istream);
-        opencallback = new COpenCallback(istream, name, password);
+        stats.Reset();
+        this->libimpl = libimpl;
+        this->istream = istream;
+        this->filename = name;
+        this->offset = offset;
+
+        instream = new CInStream(istream, false, offset, &stats);
+        if (shared)
+            CINSTREAM(instream)->Share(*shared);
+        if (readAheadBlocks > 0)
+            CINSTREAM(instream)->SetReadAhead(readAheadBlocks, readAheadBlockSize);
+        opencallback = new COpenCallback(istream, name, password, &stats);
 
         const UInt64 scan = (UInt64)1 << 23;
         while (true) {
@@ -725,6 +1879,10 @@ namespace sevenzip {
             if (hr != S_OK)
                 return hr;
 
+            hr = setProperties(inarchive, inarchives.IsEmpty());
+            if (hr != S_OK)
+                return hr;
+
             // DEBUGLOG(this << " Iarchive::open inarchive->Open");
             hr = inarchive->Open(instream, &scan, opencallback);
             if (hr == S_FALSE)
@@ -799,24 +1957,528 @@ namespace sevenzip {
         instream = nullptr;
         opencallback = nullptr;
         formatIndex = -1;
+        items.Clear();
+        snapshotted = false;
+        blocks.Clear();
+        blockmapped = false;
+        libimpl = nullptr;
+        istream = nullptr;
+        filename.Empty();
+        offset = 0;
     }
 
     HRESULT Iarchive::Impl::extract(Ostream* ostream, const wchar_t* password, int index) {
         if (!inarchive)
             return E_FAIL;
 
-        CMyComPtr<IArchiveExtractCallback> extractcallback =
-                new CExtractCallback(ostream, inarchive,
-                password ? password : COPENCALLBACK(opencallback)->Password());
+        int n = getNumberOfItems();
+        if (index >= n)
+            return E_INVALIDARG;
 
         DEBUGLOG(this << " Iarchive::Impl::extract index " << index);
-        UInt32 items[1] = {(UInt32)(Int32)index};
-        if (index < 0)
-            return inarchive->Extract(nullptr, (UInt32)(Int32)(-1), false, extractcallback);
-        else if (index < getNumberOfItems())
-            return inarchive->Extract(items, 1, false, extractcallback);
-        else
+        CRecordVector<UInt32> items;
+        items.ClearAndReserve(index < 0 ? (unsigned)n : 1);
+        for (int i = index < 0 ? 0 : index; i < (index < 0 ? n : index + 1); i++)
+            items.AddInReserved((UInt32)i);
+        return extractItems(ostream, password, items);
+    }
+
+    static int compareIndices(const UInt32* a, const UInt32* b, void* /*param*/) {
+        return *a < *b ? -1 : (*a > *b ? 1 : 0);
+    };
+
+    HRESULT Iarchive::Impl::extract(Ostream* ostream, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        if (!inarchive)
+            return E_FAIL;
+        if (!indices && count > 0)
+            return E_INVALIDARG;
+
+        DEBUGLOG(this << " Iarchive::Impl::extract count " << count);
+        CRecordVector<UInt32> items;
+        items.ClearAndReserve(count);
+        for (UInt32 i = 0; i < count; i++)
+            items.AddInReserved(indices[i]);
+        return extractItems(ostream, password, items);
+    }
+
+    HRESULT Iarchive::Impl::extract(Ostream* ostream, const wchar_t* password, Iselector* selector) {
+        if (!inarchive)
+            return E_FAIL;
+        if (!selector)
+            return E_INVALIDARG;
+
+        int n = getNumberOfItems();
+        DEBUGLOG(this << " Iarchive::Impl::extract selector " << n);
+        CRecordVector<UInt32> items;
+        for (int i = 0; i < n; i++)
+            if (selector->Select(i))
+                items.Add((UInt32)i);
+        return extractItems(ostream, password, items);
+    }
+
+    // NOTE: the deferred metadata is applied when all items are extracted, also after an error
+    HRESULT Iarchive::Impl::extractItems(Ostream* ostream, const wchar_t* password, CRecordVector<UInt32>& items) {
+        HRESULT hr = skipUnchanged(ostream, items);
+        if (hr != S_OK)
+            return hr;
+        if (metadataThreads <= 0) {
+            hr = extractStored(ostream, items, nullptr);
+            if (hr != S_OK)
+                return hr;
+            return extractSorted(ostream, nullptr, nullptr, password, items);
+        }
+        CObjectVector<CRecordVector<UInt32>> metadata;
+        metadata.Add(CRecordVector<UInt32>());
+        hr = extractStored(ostream, items, &metadata[0]);
+        if (hr == S_OK)
+            hr = extractSorted(ostream, nullptr, nullptr, password, items, &metadata[0]);
+        applyMetadata(&ostream, metadata);
+        return hr;
+    }
+
+    static void sortIndices(CRecordVector<UInt32>& items) {
+        items.Sort(compareIndices, nullptr);
+        unsigned n = 0;
+        for (unsigned i = 0; i < items.Size(); i++)
+            if (n == 0 || items[i] != items[n - 1])
+                items[n++] = items[i];
+        items.DeleteFrom(n);
+    };
+
+    static const UInt32 kStoredCheckSize = (UInt32)1 << 12;
+    static const UInt32 kTarBlockSize = 512;
+    static const unsigned kTarHeadersMax = 8;
+
+    // NOTE: the format id of the handler class id {23170F69-40C1-278A-1000-000110xx0000}
+    enum {
+        kFormatNone = 0,
+        kFormatGpt = 0xCB,
+        kFormatApm = 0xD4,
+        kFormatMbr = 0xDB,
+        kFormatIso = 0xE7,
+        kFormatTar = 0xEE
+    };
+
+    // NOTE: the formats keeping the items as plain ranges of the archive, with kpidOffset giving the data
+    // offset (iso extents, partitions) or the first header of the item (tar); the other formats, zip with
+    // its local headers included, are never copied
+    static int getStoredFormat(const GUID& guid) {
+        switch (guid.Data4[5]) {
+        case kFormatGpt:
+        case kFormatApm:
+        case kFormatMbr:
+        case kFormatIso:
+        case kFormatTar:
+            return guid.Data4[5];
+        default:
+            return kFormatNone;
+        }
+    };
+
+    static HRESULT readFully(ISequentialInStream* stream, void* data, UInt32 size) {
+        UInt32 done = 0;
+        while (done < size) {
+            UInt32 processed = 0;
+            HRESULT hr = stream->Read((Byte*)data + done, size - done, &processed);
+            if (hr != S_OK)
+                return hr;
+            if (processed == 0)
+                return S_FALSE;
+            done += processed;
+        }
+        return S_OK;
+    };
+
+    static HRESULT readFullyAt(Istream* stream, UInt64 offset, void* data, UInt32 size) {
+        UInt32 done = 0;
+        while (done < size) {
+            UInt32 processed = 0;
+            HRESULT hr = stream->ReadAt(offset + done, (Byte*)data + done, size - done, processed);
+            if (hr != S_OK)
+                return hr;
+            if (processed == 0)
+                return S_FALSE;
+            done += processed;
+        }
+        return S_OK;
+    };
+
+    static UInt64 getTarNumber(const Byte* field, unsigned size) {
+        UInt64 value = 0;
+        if (field[0] & 0x80) {
+            for (unsigned i = 1; i < size; i++)
+                value = (value << 8) | field[i];
+            return value;
+        }
+        unsigned i = 0;
+        while (i < size && field[i] == ' ')
+            i++;
+        for (; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+            value = value * 8 + (UInt64)(field[i] - '0');
+        return value;
+    };
+
+    static bool isTarHeader(const Byte* header) {
+        UInt64 sum = 0;
+        for (unsigned i = 0; i < kTarBlockSize; i++)
+            sum += (i >= 148 && i < 156) ? (Byte)' ' : header[i];
+        return sum == getTarNumber(header + 148, 8);
+    };
+
+    // NOTE: the extension headers (long names, pax) are skipped to the data following the item header,
+    // the position is taken as the data if it is not a header; sparse items are not copied
+    static HRESULT getTarDataOffset(Istream* istream, UInt64 position, UInt64& data) {
+        Byte header[kTarBlockSize];
+        for (unsigned i = 0; i < kTarHeadersMax; i++) {
+            if (readFullyAt(istream, position, header, kTarBlockSize) != S_OK)
+                return S_FALSE;
+            if (!isTarHeader(header)) {
+                data = position;
+                return i == 0 ? S_OK : S_FALSE;
+            }
+            Byte type = header[156];
+            position += kTarBlockSize;
+            if (type == 'S')
+                return S_FALSE;
+            if (type != 'L' && type != 'K' && type != 'x' && type != 'g') {
+                data = position;
+                return S_OK;
+            }
+            UInt64 size = getTarNumber(header + 124, 12);
+            position += (size + kTarBlockSize - 1) / kTarBlockSize * kTarBlockSize;
+        }
+        return S_FALSE;
+    };
+
+    // NOTE: kpidOffset is mapped to the data offset by the format, the range is trusted when the seekable
+    // handler stream of the item matches the archive bytes at both ends of the range
+    HRESULT Iarchive::Impl::getStoredRange(UInt32 index, UInt64 size, int format, UInt64& start) {
+        UInt64 position = 0;
+        if (getArchiveWideItemProperty(inarchive, index, kpidOffset, position) != S_OK)
+            return S_FALSE;
+        if (format == kFormatTar && getTarDataOffset(istream, offset + position, position) == S_OK)
+            position -= offset;
+        else if (format == kFormatTar)
+            return S_FALSE;
+        bool encrypted = false;
+        if (getArchiveBoolItemProperty(inarchive, index, kpidEncrypted, encrypted) == S_OK && encrypted)
+            return S_FALSE;
+        UString method;
+        if (getArchiveStringItemProperty(inarchive, index, kpidMethod, method) == S_OK
+                && !method.IsEmpty() && wcscmp(method, L"Copy") != 0 && wcscmp(method, L"Store") != 0)
+            return S_FALSE;
+
+        CMyComPtr<IInArchiveGetStream> getstream;
+        if (inarchive->QueryInterface(IID_IInArchiveGetStream, (void**)&getstream) != S_OK || !getstream)
+            return S_FALSE;
+        CMyComPtr<ISequentialInStream> stream;
+        if (getstream->GetStream(index, &stream) != S_OK || !stream)
+            return S_FALSE;
+        CMyComPtr<IInStream> seekable;
+        stream.QueryInterface(IID_IInStream, &seekable);
+        if (!seekable)
+            return S_FALSE;
+
+        UInt32 n = (UInt32)min(size, (UInt64)kStoredCheckSize);
+        CByteBuffer expected(n);
+        CByteBuffer actual(n);
+        UInt64 checks[2] = {0, size - n};
+        for (unsigned i = 0; i < 2; i++) {
+            UInt64 newPosition = 0;
+            if (seekable->Seek((Int64)checks[i], SZ_SEEK_SET, &newPosition) != S_OK
+                    || readFully(seekable, expected, n) != S_OK
+                    || readFullyAt(istream, offset + position + checks[i], actual, n) != S_OK
+                    || memcmp(expected, actual, n) != 0)
+                return S_FALSE;
+        }
+        start = offset + position;
+        return S_OK;
+    };
+
+    // NOTE: the stored items are copied from the archive stream by the ostream, bypassing the decoder and
+    // the callback; the items that are not stored or cannot be copied are left to the handler
+    HRESULT Iarchive::Impl::extractStored(Ostream* ostream, CRecordVector<UInt32>& wanted, CRecordVector<UInt32>* metadata) {
+        UInt64 processed = 0;
+        if (!ostream || !istream || !inarchives.IsEmpty() || !libimpl || formatIndex < 0)
+            return S_OK;
+        int format = getStoredFormat(libimpl->getFormatGUID(formatIndex));
+        if (format == kFormatNone || ostream->WriteFrom(*istream, 0, 0, processed) != S_OK)
+            return S_OK;
+        if (!snapshotted) {
+            HRESULT hr = snapshot();
+            if (hr != S_OK)
+                return hr;
+        }
+        sortIndices(wanted);
+        if (!wanted.IsEmpty() && wanted.Back() >= items.Size())
+            return E_INVALIDARG;
+
+        unsigned n = 0;
+        ItemInfo info;
+        for (unsigned i = 0; i < wanted.Size(); i++) {
+            UInt32 index = wanted[i];
+            items.Get(index, info);
+            UInt64 start = 0;
+            if (info.isDir || info.size == 0 || getStoredRange(index, info.size, format, start) != S_OK
+                    || FAILED(ostream->Open(info.path))) {
+                wanted[n++] = index;
+                continue;
+            }
+            ostream->Reserve(info.size);
+            HRESULT hr = ostream->WriteFrom(*istream, start, info.size, processed);
+            ostream->Close();
+            DEBUGLOG(this << " Iarchive::Impl::extractStored " << index << " hr " << hr << " " << processed);
+            if (hr != S_OK || processed != info.size) {
+                wanted[n++] = index;
+                continue;
+            }
+            STATS_ADD(&stats, copies, 1);
+            STATS_ADD(&stats, copyBytes, processed);
+            if (metadata)
+                metadata->Add(index);
+            else
+                setItemMetadata(ostream, info);
+        }
+        wanted.DeleteFrom(n);
+        return S_OK;
+    };
+
+    // NOTE: handlers expect ascending unique indices, solid blocks are decoded once per call,
+    // factory streams and deferred metadata use the items table taken by this or the parent handler
+    HRESULT Iarchive::Impl::extractSorted(Ostream* ostream, OstreamFactory* factory, const CItemTable* table,
+            const wchar_t* password, CRecordVector<UInt32>& items, CRecordVector<UInt32>* metadata) {
+        sortIndices(items);
+
+        if (items.IsEmpty())
+            return S_OK;
+        if (items.Back() >= (UInt32)getNumberOfItems())
+            return E_INVALIDARG;
+        if ((factory || metadata) && !table) {
+            if (!snapshotted) {
+                HRESULT hr = snapshot();
+                if (hr != S_OK)
+                    return hr;
+            }
+            table = &this->items;
+        }
+
+        if (!password)
+            password = COPENCALLBACK(opencallback)->Password();
+        CExtractCallback* callback = factory
+                ? new CExtractCallback(factory, table, inarchive, password, &stats)
+                : new CExtractCallback(ostream, inarchive, password, &stats);
+        CMyComPtr<IArchiveExtractCallback> extractcallback = callback;
+        callback->SetWriteBehind(writeBehindBuffers, writeBehindBufferSize);
+        if (metadata)
+            callback->SetDeferredMetadata(table, metadata);
+
+        return inarchive->Extract(&items[0], items.Size(), false, extractcallback);
+    }
+
+    static int compareUnitCosts(const UInt32* a, const UInt32* b, void* param) {
+        const CRecordVector<BlockPlan>& units = *(const CRecordVector<BlockPlan>*)param;
+        if (units[*a].cost != units[*b].cost)
+            return units[*a].cost > units[*b].cost ? -1 : 1;
+        return *a < *b ? -1 : (*a > *b ? 1 : 0);
+    };
+
+    // NOTE: items of a solid block have to be decoded by the same handler,
+    // solid archives without the block map are not parallelized
+    bool Iarchive::Impl::isParallelizable() {
+        if (!inarchive || !inarchives.IsEmpty() || !libimpl || !istream || formatIndex < 0)
+            return false;
+        bool solid = false;
+        if (getBoolProperty(kpidSolid, solid) == S_OK && solid)
+            return buildBlockMap() == S_OK && blocks.Size() > 1;
+        return true;
+    };
+
+    // NOTE: the worker opens its own handler on the cloned or shared stream, the items table is shared
+    HRESULT Iarchive::Impl::extractCloned(Istream* clone, const CInStream* shared, Ostream* ostream, OstreamFactory* factory,
+            const wchar_t* password, CRecordVector<UInt32>& items, CRecordVector<UInt32>* metadata) {
+        Iarchive::Impl worker;
+        worker.setReadAhead(readAheadBlocks, readAheadBlockSize);
+        worker.setWriteBehind(writeBehindBuffers, writeBehindBufferSize);
+        worker.properties = properties;
+        HRESULT hr = worker.open(libimpl, clone, filename, COPENCALLBACK(opencallback)->Password(), formatIndex, offset, shared);
+        if (hr == S_OK)
+            hr = worker.extractSorted(ostream, factory, factory || metadata ? &this->items : nullptr, password, items, metadata);
+        stats.Add(worker.stats);
+        worker.close();
+        if (!shared)
+            clone->Close();
+        return hr;
+    };
+
+    HRESULT Iarchive::Impl::extract(Ostream* const* ostreams, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        if (!inarchive)
+            return E_FAIL;
+        if (!ostreams || numThreads < 1)
+            return E_INVALIDARG;
+        for (int i = 0; i < numThreads; i++)
+            if (!ostreams[i])
+                return E_INVALIDARG;
+        if (metadataThreads <= 0)
+            return extractParallel(ostreams, nullptr, numThreads, password, indices, count);
+        CObjectVector<CRecordVector<UInt32>> metadata;
+        for (int i = 0; i < numThreads; i++)
+            metadata.Add(CRecordVector<UInt32>());
+        HRESULT hr = extractParallel(ostreams, nullptr, numThreads, password, indices, count, &metadata);
+        applyMetadata(ostreams, metadata);
+        return hr;
+    }
+
+    HRESULT Iarchive::Impl::extract(OstreamFactory* factory, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count) {
+        if (!inarchive)
+            return E_FAIL;
+        if (!factory || numThreads < 1)
             return E_INVALIDARG;
+        return extractParallel(nullptr, factory, numThreads, password, indices, count);
+    }
+
+    // NOTE: the handler stream is used when the handler reads the item directly, stored items usually,
+    // other items are decoded by a background thread into a bounded buffer
+    HRESULT Iarchive::Impl::openItem(int index, const wchar_t* password, Istream*& istream, UInt32 bufferSize) {
+        istream = nullptr;
+        if (!inarchive)
+            return E_FAIL;
+        if (index < 0 || index >= getNumberOfItems() || getItemIsDir(index))
+            return E_INVALIDARG;
+
+        UInt64 size = getItemSize(index);
+        CMyComPtr<IInArchiveGetStream> getstream;
+        if (inarchive->QueryInterface(IID_IInArchiveGetStream, (void**)&getstream) == S_OK && getstream) {
+            CMyComPtr<ISequentialInStream> stream;
+            if (getstream->GetStream((UInt32)index, &stream) == S_OK && stream) {
+                DEBUGLOG(this << " Iarchive::Impl::openItem " << index << " handler stream");
+                istream = new CItemIstream(stream, size);
+                return S_OK;
+            }
+        }
+
+        DEBUGLOG(this << " Iarchive::Impl::openItem " << index << " decoder thread");
+        CPipeIstream* pipe = new CPipeIstream(size, bufferSize);
+        HRESULT hr = pipe->Start(inarchive, (UInt32)index,
+                password ? password : COPENCALLBACK(opencallback)->Password(), &stats);
+        if (hr != S_OK) {
+            delete pipe;
+            return hr;
+        }
+        istream = pipe;
+        return S_OK;
+    }
+
+    // NOTE: blocks and items out of blocks are partitioned by the estimated cost,
+    // largest first to the least loaded worker, the first partition is extracted
+    // by this handler on the calling thread
+    HRESULT Iarchive::Impl::extractParallel(Ostream* const* ostreams, OstreamFactory* factory, int numThreads,
+            const wchar_t* password, const UInt32* indices, UInt32 count,
+            CObjectVector<CRecordVector<UInt32>>* metadata) {
+        if (!indices && count > 0)
+            return E_INVALIDARG;
+        // NOTE: the workers share the items table, it is taken before they start
+        if ((factory || metadata) && !snapshotted) {
+            HRESULT hr = snapshot();
+            if (hr != S_OK)
+                return hr;
+        }
+
+        DEBUGLOG(this << " Iarchive::Impl::extract count " << count << " threads " << numThreads);
+        CRecordVector<UInt32> items;
+        items.ClearAndReserve(count);
+        for (UInt32 i = 0; i < count; i++)
+            items.AddInReserved(indices[i]);
+        sortIndices(items);
+        if (ostreams) {
+            HRESULT hr = skipUnchanged(ostreams[0], items);
+            if (hr == S_OK)
+                hr = extractStored(ostreams[0], items, metadata ? &(*metadata)[0] : nullptr);
+            if (hr != S_OK)
+                return hr;
+        }
+
+        Ostream* ostream = ostreams ? ostreams[0] : nullptr;
+        unsigned nworkers = (unsigned)numThreads < items.Size() ? (unsigned)numThreads : items.Size();
+        if (nworkers < 2 || !isParallelizable())
+            return extractSorted(ostream, factory, nullptr, password, items, metadata ? &(*metadata)[0] : nullptr);
+        if (items.Back() >= (UInt32)getNumberOfItems())
+            return E_INVALIDARG;
+        HRESULT hr = buildBlockMap();
+        if (hr != S_OK)
+            return hr;
+
+        CRecordVector<UInt32> itemUnits;
+        CRecordVector<BlockPlan> units;
+        planUnits(items, itemUnits, units);
+        if (units.Size() < nworkers)
+            nworkers = units.Size();
+        if (nworkers < 2)
+            return extractSorted(ostream, factory, nullptr, password, items, metadata ? &(*metadata)[0] : nullptr);
+
+        // NOTE: the stream with positional reads is shared by the workers, the end is taken
+        // before the workers start so they never move the stream position
+        CInStream* shared = CINSTREAM(instream);
+        UInt64 end = 0;
+        if (!shared->IsPositional() || shared->GetEnd(end) != S_OK)
+            shared = nullptr;
+        CRecordVector<Istream*> clones;
+        for (unsigned w = 1; w < nworkers && !shared; w++) {
+            Istream* clone = istream->Clone();
+            if (!clone)
+                break;
+            clones.Add(clone);
+        }
+        if (!shared && clones.Size() + 1 < nworkers) {
+            DEBUGLOG(this << " Iarchive::Impl::extract clone failed, sequential");
+            for (unsigned i = 0; i < clones.Size(); i++)
+                delete clones[i];
+            return extractSorted(ostream, factory, nullptr, password, items, metadata ? &(*metadata)[0] : nullptr);
+        }
+
+        CRecordVector<UInt32> order;
+        for (unsigned u = 0; u < units.Size(); u++)
+            order.Add(u);
+        order.Sort(compareUnitCosts, &units);
+        CRecordVector<UInt32> unitWorkers(order);
+        CRecordVector<UInt64> loads;
+        for (unsigned w = 0; w < nworkers; w++)
+            loads.Add(0);
+        for (unsigned i = 0; i < order.Size(); i++) {
+            unsigned w = 0;
+            for (unsigned j = 1; j < nworkers; j++)
+                if (loads[j] < loads[w])
+                    w = j;
+            unitWorkers[order[i]] = w;
+            loads[w] += units[order[i]].cost;
+        }
+        CObjectVector<CRecordVector<UInt32>> parts;
+        for (unsigned w = 0; w < nworkers; w++)
+            parts.Add(CRecordVector<UInt32>());
+        for (unsigned i = 0; i < items.Size(); i++)
+            parts[unitWorkers[itemUnits[i]]].Add(items[i]);
+
+        CRecordVector<HRESULT> results;
+        for (unsigned w = 0; w < nworkers; w++)
+            results.Add(S_OK);
+        std::vector<std::thread> threads;
+        threads.reserve(nworkers - 1);
+        for (unsigned w = 1; w < nworkers; w++)
+            threads.emplace_back([this, &clones, &results, &parts, shared, ostreams, factory, password, metadata, w]() {
+                results[w] = extractCloned(shared ? istream : clones[w - 1], shared,
+                        ostreams ? ostreams[w] : nullptr, factory, password, parts[w],
+                        metadata ? &(*metadata)[w] : nullptr);
+            });
+        results[0] = extractSorted(ostream, factory, &this->items, password, parts[0],
+                metadata ? &(*metadata)[0] : nullptr);
+        for (unsigned i = 0; i < threads.size(); i++)
+            threads[i].join();
+        for (unsigned i = 0; i < clones.Size(); i++)
+            delete clones[i];
+
+        for (unsigned w = 0; w < nworkers; w++)
+            if (results[w] != S_OK)
+                return results[w];
+        return S_OK;
     }
 
     int Iarchive::Impl::getNumberOfItems() {
@@ -831,7 +2493,9 @@ namespace sevenzip {
 		lastItemPath[0] = L'\0';
         if (!inarchive)
             return lastItemPath;
-        if (getArchiveStringItemProperty(inarchive, index, kpidPath, path) == S_OK)
+        if (snapshotted && (unsigned)index < items.Size())
+            COPYWCHARS(lastItemPath, &items.paths[items.pathOffsets[index]]);
+        else if (getArchiveStringItemProperty(inarchive, index, kpidPath, path) == S_OK)
             COPYWCHARS(lastItemPath, path.Ptr());
         else
             COPYWCHARS(lastItemPath, kEmptyFileAlias);
@@ -841,6 +2505,8 @@ namespace sevenzip {
     UInt64 Iarchive::Impl::getItemSize(int index) {
         if (!inarchive)
             return 0;
+        if (snapshotted && (unsigned)index < items.Size())
+            return items.sizes[index];
         UInt64 size64;
         if (getArchiveWideItemProperty(inarchive, index, kpidSize, size64) == S_OK)
             return size64;
@@ -851,23 +2517,28 @@ namespace sevenzip {
     };
 
     UInt32 Iarchive::Impl::getItemMode(int index) {
+        if (snapshotted && (unsigned)index < items.Size())
+            return items.modes[index];
         UInt32 mode;
         if (getArchiveIntItemProperty(inarchive, index, kpidPosixAttrib, mode) == S_OK)
             return mode;
         if (getArchiveIntItemProperty(inarchive, index, kpidAttrib, mode) == S_OK)
-            if (mode & 0x8000)
-                return mode >> 16; // p7zip posix feature
+            return getModeFromAttr(mode);
         return 0;
     };
 
     UInt32 Iarchive::Impl::getItemAttr(int index) {
+        if (snapshotted && (unsigned)index < items.Size())
+            return items.attrs[index];
         UInt32 attr;
         if (getArchiveIntItemProperty(inarchive, index, kpidAttrib, attr) == S_OK)
-            return (attr & 0x8000) ? attr & 0x7FFF : attr;
+            return getAttrFromAttr(attr);
         return 0;
     };
 
     UInt32 Iarchive::Impl::getItemTime(int index) {
+        if (snapshotted && (unsigned)index < items.Size())
+            return items.times[index];
         UInt32 time;
         if (getArchiveTimeItemProperty(inarchive, index, kpidMTime, time) == S_OK)
             return time;
@@ -875,41 +2546,565 @@ namespace sevenzip {
     };
 
     bool Iarchive::Impl::getItemIsDir(int index) {
+        if (snapshotted && (unsigned)index < items.Size())
+            return (items.flags[index] & CItemTable::kIsDir) != 0;
         bool isdir;
         if (!inarchive || getArchiveBoolItemProperty(inarchive, index, kpidIsDir, isdir) != S_OK)
             return false;
         return isdir;
     };
 
-    int Iarchive::Impl::getNumberOfProperties() {
-        UInt32 n;
-        if (inarchive && inarchive->GetNumberOfArchiveProperties(&n) == S_OK)
-            return n;
-        return 0;
-    };
-
-    HRESULT Iarchive::Impl::getPropertyInfo(int propIndex, PROPID& propId, VARTYPE& propType) {
-        CMyComBSTR name;
+    // NOTE: optional properties are fetched only if the handler declares them
+    HRESULT Iarchive::Impl::snapshot() {
+        DEBUGLOG(this << " Iarchive::snapshot");
         if (!inarchive)
-            return S_FALSE;
-        HRESULT hr = inarchive->GetArchivePropertyInfo(propIndex, &name, &propId, &propType);
+            return E_FAIL;
+
+        items.Clear();
+        snapshotted = false;
+        blocks.Clear();
+        blockmapped = false;
+
+        bool haspacksize = false, hascrc = false, hasblock = false;
+        int nprops = getNumberOfItemProperties();
+        for (int i = 0; i < nprops; i++) {
+            PROPID propId;
+            VARTYPE propType;
+            if (getItemPropertyInfo(i, propId, propType) != S_OK)
+                continue;
+            if (propId == kpidPackSize)
+                haspacksize = true;
+            else if (propId == kpidCRC)
+                hascrc = true;
+            else if (propId == kpidBlock)
+                hasblock = true;
+        }
+
+        UInt32 n = 0;
+        HRESULT hr = inarchive->GetNumberOfItems(&n);
         if (hr != S_OK)
             return hr;
+
+        items.pathOffsets.ClearAndReserve(n + 1);
+        items.sizes.ClearAndReserve(n);
+        items.packSizes.ClearAndReserve(n);
+        items.times.ClearAndReserve(n);
+        items.attrs.ClearAndReserve(n);
+        items.modes.ClearAndReserve(n);
+        items.crcs.ClearAndReserve(n);
+        items.blocks.ClearAndReserve(n);
+        items.flags.ClearAndReserve(n);
+
+        UString path;
+        for (UInt32 i = 0; i < n; i++) {
+            if (getArchiveStringItemProperty(inarchive, i, kpidPath, path) != S_OK)
+                path = kEmptyFileAlias;
+            items.pathOffsets.AddInReserved(items.paths.Size());
+            for (unsigned c = 0; c <= path.Len(); c++)
+                items.paths.Add(path.Ptr()[c]);
+
+            Byte flags = 0;
+            bool isdir = false;
+            if (getArchiveBoolItemProperty(inarchive, i, kpidIsDir, isdir) == S_OK && isdir)
+                flags |= CItemTable::kIsDir;
+
+            UInt64 size = 0, packsize = 0;
+            getArchiveSizeItemProperty(inarchive, i, kpidSize, size);
+            if (haspacksize)
+                getArchiveSizeItemProperty(inarchive, i, kpidPackSize, packsize);
+
+            UInt32 time = 0, attr = 0, mode = 0, crc = 0, block = 0;
+            getArchiveTimeItemProperty(inarchive, i, kpidMTime, time);
+            if (getArchiveIntItemProperty(inarchive, i, kpidAttrib, attr) != S_OK)
+                attr = 0;
+            if (getArchiveIntItemProperty(inarchive, i, kpidPosixAttrib, mode) != S_OK)
+                mode = getModeFromAttr(attr);
+            if (hascrc && getArchiveIntItemProperty(inarchive, i, kpidCRC, crc) == S_OK)
+                flags |= CItemTable::kHasCrc;
+            if (hasblock && getArchiveIntItemProperty(inarchive, i, kpidBlock, block) == S_OK)
+                flags |= CItemTable::kHasBlock;
+
+            items.sizes.AddInReserved(size);
+            items.packSizes.AddInReserved(packsize);
+            items.times.AddInReserved(time);
+            items.attrs.AddInReserved(getAttrFromAttr(attr));
+            items.modes.AddInReserved(mode);
+            items.crcs.AddInReserved(crc);
+            items.blocks.AddInReserved(block);
+            items.flags.AddInReserved(flags);
+        }
+        items.pathOffsets.AddInReserved(items.paths.Size());
+
+        DEBUGLOG(this << " Iarchive::snapshot items " << n << " chars " << items.paths.Size());
+        snapshotted = true;
         return S_OK;
     };
 
-    HRESULT Iarchive::Impl::getStringProperty(PROPID propId, const wchar_t*& propValue) {
+    HRESULT Iarchive::Impl::getItemInfo(int index, ItemInfo& info) {
         if (!inarchive)
             return E_FAIL;
-        NWindows::NCOM::CPropVariant prop;
-        HRESULT hr = inarchive->GetArchiveProperty(propId, &prop);
-        if (hr != S_OK)
-            return hr;
-        if (prop.vt == VT_EMPTY)
-            return S_FALSE;
-        if (prop.vt == VT_BSTR)
-            propValue = COPYWCHARS(lastStringProperty, prop.bstrVal);
-        else
+        if (!snapshotted) {
+            HRESULT hr = snapshot();
+            if (hr != S_OK)
+                return hr;
+        }
+        if (index < 0 || (unsigned)index >= items.Size())
+            return E_INVALIDARG;
+        items.Get(index, info);
+        return S_OK;
+    };
+    static UInt32 getPathDepth(const wchar_t* path) {
+        UInt32 depth = 0;
+        for (; *path; path++)
+#ifdef _WIN32
+            if (*path == L'\\' || *path == L'/')
+#else
+            if (*path == L'/')
+#endif
+                depth++;
+        return depth;
+    };
+
+    static int compareMetadataDepths(const CMetadataItem* a, const CMetadataItem* b, void* /*param*/) {
+        if (a->depth != b->depth)
+            return a->depth > b->depth ? -1 : 1;
+        return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+    };
+
+    // NOTE: the files are set by the pool, the directories are set last and deepest first, so their
+    // times are not changed by the entries created later and their modes do not block the subdirectories
+    void Iarchive::Impl::applyMetadata(Ostream* const* ostreams, const CObjectVector<CRecordVector<UInt32>>& metadata) {
+        CRecordVector<CMetadataItem> files;
+        CRecordVector<CMetadataItem> dirs;
+        for (unsigned w = 0; w < metadata.Size(); w++) {
+            for (unsigned i = 0; i < metadata[w].Size(); i++) {
+                CMetadataItem item;
+                item.index = metadata[w][i];
+                item.depth = 0;
+                item.stream = w;
+                if (item.index >= items.Size())
+                    continue;
+                if (items.flags[item.index] & CItemTable::kIsDir) {
+                    item.depth = getPathDepth(&items.paths[items.pathOffsets[item.index]]);
+                    dirs.Add(item);
+                } else {
+                    files.Add(item);
+                }
+            }
+        }
+        DEBUGLOG(this << " Iarchive::Impl::applyMetadata files " << files.Size() << " dirs " << dirs.Size());
+
+        std::atomic<unsigned> next(0);
+        auto run = [this, ostreams, &files, &next]() {
+            ItemInfo info;
+            for (unsigned i = next.fetch_add(1); i < files.Size(); i = next.fetch_add(1)) {
+                items.Get(files[i].index, info);
+                setItemMetadata(ostreams[files[i].stream], info);
+            }
+        };
+        unsigned nthreads = min((unsigned)metadataThreads, files.Size());
+        std::vector<std::thread> threads;
+        if (nthreads > 1) {
+            threads.reserve(nthreads - 1);
+            for (unsigned t = 1; t < nthreads; t++)
+                threads.emplace_back(run);
+        }
+        run();
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+
+        dirs.Sort(compareMetadataDepths, nullptr);
+        ItemInfo info;
+        for (unsigned i = 0; i < dirs.Size(); i++) {
+            items.Get(dirs[i].index, info);
+            setItemMetadata(ostreams[dirs[i].stream], info);
+        }
+    };
+
+    // NOTE: the cheap size and time check goes first, the destination CRC is read only when they match
+    static bool isItemUnchanged(Ostream* ostream, const ItemInfo& info, int mode) {
+        if (info.isDir || info.time == 0)
+            return false;
+        UInt64 size = 0;
+        UInt32 time = 0;
+        if (ostream->Stat(info.path, size, time) != S_OK || size != info.size || time != info.time)
+            return false;
+        if (mode != SKIP_CRC || !info.hasCrc)
+            return true;
+        UInt32 crc = 0;
+        return ostream->GetCrc(info.path, crc) == S_OK && crc == info.crc;
+    };
+
+    // NOTE: the destinations are checked by the pool before the handler is called, so the unchanged
+    // items are never asked for a stream and the solid blocks with no changed items are not decoded
+    HRESULT Iarchive::Impl::skipUnchanged(Ostream* ostream, CRecordVector<UInt32>& wanted) {
+        if (!ostream || skipMode == SKIP_NONE)
+            return S_OK;
+        if (!snapshotted) {
+            HRESULT hr = snapshot();
+            if (hr != S_OK)
+                return hr;
+        }
+        sortIndices(wanted);
+        if (!wanted.IsEmpty() && wanted.Back() >= items.Size())
+            return E_INVALIDARG;
+
+        CRecordVector<Byte> unchanged;
+        unchanged.ClearAndSetSize(wanted.Size());
+        std::atomic<unsigned> next(0);
+        auto run = [this, ostream, &wanted, &unchanged, &next]() {
+            ItemInfo info;
+            for (unsigned i = next.fetch_add(1); i < wanted.Size(); i = next.fetch_add(1)) {
+                items.Get(wanted[i], info);
+                unchanged[i] = isItemUnchanged(ostream, info, skipMode) ? 1 : 0;
+            }
+        };
+        unsigned nthreads = skipThreads > 0 ? (unsigned)skipThreads : (unsigned)getNumberOfThreads();
+        nthreads = min(nthreads, wanted.Size());
+        std::vector<std::thread> threads;
+        if (nthreads > 1) {
+            threads.reserve(nthreads - 1);
+            for (unsigned t = 1; t < nthreads; t++)
+                threads.emplace_back(run);
+        }
+        run();
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+
+        unsigned n = 0;
+        for (unsigned i = 0; i < wanted.Size(); i++) {
+            if (unchanged[i]) {
+                STATS_ADD(&stats, skips, 1);
+                STATS_ADD(&stats, skipBytes, items.sizes[wanted[i]]);
+            } else {
+                wanted[n++] = wanted[i];
+            }
+        }
+        DEBUGLOG(this << " Iarchive::Impl::skipUnchanged " << wanted.Size() - n << " of " << wanted.Size());
+        wanted.DeleteFrom(n);
+        return S_OK;
+    };
+
+    HRESULT Iarchive::Impl::findChanged(Ostream* ostream, const UInt32* indices, UInt32 count,
+            UInt32* changed, UInt32& numChanged) {
+        numChanged = 0;
+        if (!inarchive)
+            return E_FAIL;
+        if ((!indices || !changed) && count > 0)
+            return E_INVALIDARG;
+
+        CRecordVector<UInt32> wanted;
+        wanted.ClearAndReserve(count);
+        for (UInt32 i = 0; i < count; i++)
+            wanted.AddInReserved(indices[i]);
+        sortIndices(wanted);
+        if (!wanted.IsEmpty() && wanted.Back() >= (UInt32)getNumberOfItems())
+            return E_INVALIDARG;
+        HRESULT hr = skipUnchanged(ostream, wanted);
+        if (hr != S_OK)
+            return hr;
+        for (unsigned i = 0; i < wanted.Size(); i++)
+            changed[i] = wanted[i];
+        numChanged = wanted.Size();
+        return S_OK;
+    };
+
+    static int compareItemBlocks(const UInt32* a, const UInt32* b, void* param) {
+        const CItemTable& table = *(const CItemTable*)param;
+        if (table.blocks[*a] != table.blocks[*b])
+            return table.blocks[*a] < table.blocks[*b] ? -1 : 1;
+        return *a < *b ? -1 : (*a > *b ? 1 : 0);
+    };
+
+    // NOTE: built once from the snapshot, the method is taken from the first block item
+    HRESULT Iarchive::Impl::buildBlockMap() {
+        if (!inarchive)
+            return E_FAIL;
+        if (blockmapped)
+            return S_OK;
+        if (!snapshotted) {
+            HRESULT hr = snapshot();
+            if (hr != S_OK)
+                return hr;
+        }
+
+        blocks.Clear();
+        unsigned n = items.Size();
+        CRecordVector<UInt32> order;
+        for (unsigned i = 0; i < n; i++)
+            if (items.flags[i] & CItemTable::kHasBlock)
+                order.Add(i);
+        order.Sort(compareItemBlocks, &items);
+
+        blocks.itemBlocks.ClearAndReserve(n);
+        for (unsigned i = 0; i < n; i++)
+            blocks.itemBlocks.AddInReserved(-1);
+        blocks.items.ClearAndReserve(order.Size());
+        blocks.itemEnds.ClearAndReserve(order.Size());
+
+        UInt64 end = 0;
+        UString method;
+        for (unsigned k = 0; k < order.Size(); k++) {
+            UInt32 i = order[k];
+            if (blocks.ids.IsEmpty() || blocks.ids.Back() != items.blocks[i]) {
+                blocks.ids.Add(items.blocks[i]);
+                blocks.packSizes.Add(0);
+                blocks.itemOffsets.Add(blocks.items.Size());
+                blocks.methodOffsets.Add(blocks.methods.Size());
+                if (getArchiveStringItemProperty(inarchive, i, kpidMethod, method) != S_OK)
+                    method.Empty();
+                for (unsigned c = 0; c <= method.Len(); c++)
+                    blocks.methods.Add(method.Ptr()[c]);
+                end = 0;
+            }
+            end += items.sizes[i];
+            blocks.packSizes.Back() += items.packSizes[i];
+            blocks.itemBlocks[i] = (int)blocks.ids.Size() - 1;
+            blocks.items.AddInReserved(i);
+            blocks.itemEnds.AddInReserved(end);
+        }
+        blocks.itemOffsets.Add(blocks.items.Size());
+
+        DEBUGLOG(this << " Iarchive::buildBlockMap blocks " << blocks.Size() << " items " << order.Size());
+        blockmapped = true;
+        return S_OK;
+    };
+
+    int Iarchive::Impl::getNumberOfBlocks() {
+        if (buildBlockMap() != S_OK)
+            return 0;
+        return blocks.Size();
+    };
+
+    HRESULT Iarchive::Impl::getBlockInfo(int blockIndex, BlockInfo& info) {
+        HRESULT hr = buildBlockMap();
+        if (hr != S_OK)
+            return hr;
+        if (blockIndex < 0 || (unsigned)blockIndex >= blocks.Size())
+            return E_INVALIDARG;
+        blocks.Get(blockIndex, info);
+        return S_OK;
+    };
+
+    // NOTE: wanted items are sorted, a block is decoded from the start up to its last wanted item,
+    // the packed size read is estimated proportionally, every item out of blocks is a separate unit
+    void Iarchive::Impl::planUnits(const CRecordVector<UInt32>& wanted,
+            CRecordVector<UInt32>& itemUnits, CRecordVector<BlockPlan>& units) {
+        itemUnits.ClearAndReserve(wanted.Size());
+        units.Clear();
+        CRecordVector<int> blockUnits;
+        for (unsigned b = 0; b < blocks.Size(); b++)
+            blockUnits.Add(-1);
+
+        for (unsigned k = 0; k < wanted.Size(); k++) {
+            UInt32 i = wanted[k];
+            int b = blocks.itemBlocks[i];
+            if (b < 0 || blockUnits[b] < 0) {
+                BlockPlan unit;
+                unit.block = b < 0 ? (UInt32)(Int32)-1 : (UInt32)b;
+                unit.numItems = 0;
+                unit.wantedSize = 0;
+                unit.decodeSize = 0;
+                unit.wastedSize = 0;
+                unit.cost = b < 0 ? items.packSizes[i] : 0;
+                if (b >= 0)
+                    blockUnits[b] = (int)units.Size();
+                units.Add(unit);
+            }
+            unsigned u = b < 0 ? units.Size() - 1 : (unsigned)blockUnits[b];
+            BlockPlan& unit = units[u];
+            unit.numItems++;
+            unit.wantedSize += items.sizes[i];
+            if (b < 0) {
+                unit.decodeSize += items.sizes[i];
+            } else {
+                // binary search of the item in the block
+                unsigned lo = blocks.itemOffsets[b], hi = blocks.itemOffsets[b + 1];
+                while (lo + 1 < hi) {
+                    unsigned mid = (lo + hi) / 2;
+                    if (blocks.items[mid] <= i)
+                        lo = mid;
+                    else
+                        hi = mid;
+                }
+                unit.decodeSize = blocks.itemEnds[lo];
+            }
+            itemUnits.AddInReserved(u);
+        }
+
+        for (unsigned u = 0; u < units.Size(); u++) {
+            BlockPlan& unit = units[u];
+            unit.wastedSize = unit.decodeSize - unit.wantedSize;
+            if (unit.block != (UInt32)(Int32)-1) {
+                UInt64 size = blocks.itemEnds[blocks.itemOffsets[unit.block + 1] - 1];
+                UInt64 packsize = blocks.packSizes[unit.block];
+                unit.cost = size > 0 ? (UInt64)((double)packsize * unit.decodeSize / size) : packsize;
+            }
+            // NOTE: every unit has some overhead, empty files and directories too
+            unit.cost += unit.decodeSize + 1;
+        }
+    };
+
+    HRESULT Iarchive::Impl::planExtract(const UInt32* indices, UInt32 count, ExtractPlan& plan,
+            BlockPlan* blockPlans, UInt32 maxBlocks) {
+        if (!inarchive)
+            return E_FAIL;
+        if (!indices && count > 0)
+            return E_INVALIDARG;
+        HRESULT hr = buildBlockMap();
+        if (hr != S_OK)
+            return hr;
+
+        CRecordVector<UInt32> wanted;
+        wanted.ClearAndReserve(count);
+        for (UInt32 i = 0; i < count; i++)
+            wanted.AddInReserved(indices[i]);
+        sortIndices(wanted);
+        if (!wanted.IsEmpty() && wanted.Back() >= items.Size())
+            return E_INVALIDARG;
+
+        CRecordVector<UInt32> itemUnits;
+        CRecordVector<BlockPlan> units;
+        planUnits(wanted, itemUnits, units);
+
+        // items out of blocks are reported as a single plan
+        BlockPlan loose;
+        loose.block = (UInt32)(Int32)-1;
+        loose.numItems = 0;
+        loose.wantedSize = 0;
+        loose.decodeSize = 0;
+        loose.wastedSize = 0;
+        loose.cost = 0;
+
+        plan.numBlocks = 0;
+        plan.wantedSize = 0;
+        plan.decodeSize = 0;
+        plan.wastedSize = 0;
+        plan.cost = 0;
+        for (unsigned u = 0; u < units.Size(); u++) {
+            const BlockPlan& unit = units[u];
+            plan.wantedSize += unit.wantedSize;
+            plan.decodeSize += unit.decodeSize;
+            plan.wastedSize += unit.wastedSize;
+            plan.cost += unit.cost;
+            if (unit.block == (UInt32)(Int32)-1) {
+                loose.numItems += unit.numItems;
+                loose.wantedSize += unit.wantedSize;
+                loose.decodeSize += unit.decodeSize;
+                loose.cost += unit.cost;
+                continue;
+            }
+            if (blockPlans && plan.numBlocks < maxBlocks)
+                blockPlans[plan.numBlocks] = unit;
+            plan.numBlocks++;
+        }
+        if (loose.numItems > 0) {
+            if (blockPlans && plan.numBlocks < maxBlocks)
+                blockPlans[plan.numBlocks] = loose;
+            plan.numBlocks++;
+        }
+        return S_OK;
+    };
+
+    void Iarchive::Impl::setReadAhead(UInt32 numBlocks, UInt32 blockSize) {
+        readAheadBlocks = numBlocks;
+        readAheadBlockSize = blockSize;
+    };
+
+    void Iarchive::Impl::setWriteBehind(UInt32 numBuffers, UInt32 bufferSize) {
+        writeBehindBuffers = numBuffers;
+        writeBehindBufferSize = bufferSize;
+    };
+
+    void Iarchive::Impl::setDeferredMetadata(int numThreads) {
+        metadataThreads = numThreads > 0 ? numThreads : 0;
+    };
+
+    void Iarchive::Impl::setSkipUnchanged(int mode, int numThreads) {
+        skipMode = mode == SKIP_SIZE_TIME || mode == SKIP_CRC ? mode : SKIP_NONE;
+        skipThreads = numThreads > 0 ? numThreads : 0;
+    };
+
+    // NOTE: the properties are usually meant for the outer decoder (mt of xz), the errors of the
+    // nested handlers are ignored
+    HRESULT Iarchive::Impl::setProperties(IInArchive* archive, bool outer) {
+        UInt32 used = 0;
+        HRESULT hr = properties.Apply(archive, (UInt32)getNumberOfThreads(), used);
+        DEBUGLOG(this << " Iarchive::setProperties outer " << outer << " mt " << used << " hr " << hr);
+        if (outer)
+            stats.threads.store(used, std::memory_order_relaxed);
+        return outer ? hr : S_OK;
+    };
+
+    HRESULT Iarchive::Impl::setStringProperty(const wchar_t* name, const wchar_t* value) {
+        DEBUGLOG(this << " Iarchive::setStringProperty " << (name ? name : L"NULL") << " " << (value ? value : L"NULL"));
+        NWindows::NCOM::CPropVariant prop = L"";
+        if (value)
+            prop = value;
+        return properties.Set(name, prop);
+    };
+
+    HRESULT Iarchive::Impl::setBoolProperty(const wchar_t* name, bool value) {
+        DEBUGLOG(this << " Iarchive::setBoolProperty " << (name ? name : L"NULL") << " " << value);
+        NWindows::NCOM::CPropVariant prop = value;
+        return properties.Set(name, prop);
+    };
+
+    HRESULT Iarchive::Impl::setIntProperty(const wchar_t* name, UInt32 value) {
+        DEBUGLOG(this << " Iarchive::setIntProperty " << (name ? name : L"NULL") << " " << value);
+        NWindows::NCOM::CPropVariant prop = value;
+        return properties.Set(name, prop);
+    };
+
+    HRESULT Iarchive::Impl::setWideProperty(const wchar_t* name, UInt64 value) {
+        DEBUGLOG(this << " Iarchive::setWideProperty " << (name ? name : L"NULL") << " " << value);
+        NWindows::NCOM::CPropVariant prop = value;
+        return properties.Set(name, prop);
+    };
+
+    HRESULT Iarchive::Impl::setEmptyProperty(const wchar_t* name) {
+        DEBUGLOG(this << " Iarchive::setEmptyProperty " << (name ? name : L"NULL"));
+        NWindows::NCOM::CPropVariant prop;
+        return properties.Set(name, prop);
+    };
+
+    void Iarchive::Impl::getStats(Stats& stats) {
+        this->stats.Get(stats);
+    };
+
+    void Iarchive::Impl::resetStats() {
+        stats.Reset();
+    };
+
+    int Iarchive::Impl::getNumberOfProperties() {
+        UInt32 n;
+        if (inarchive && inarchive->GetNumberOfArchiveProperties(&n) == S_OK)
+            return n;
+        return 0;
+    };
+
+    HRESULT Iarchive::Impl::getPropertyInfo(int propIndex, PROPID& propId, VARTYPE& propType) {
+        CMyComBSTR name;
+        if (!inarchive)
+            return S_FALSE;
+        HRESULT hr = inarchive->GetArchivePropertyInfo(propIndex, &name, &propId, &propType);
+        if (hr != S_OK)
+            return hr;
+        return S_OK;
+    };
+
+    HRESULT Iarchive::Impl::getStringProperty(PROPID propId, const wchar_t*& propValue) {
+        if (!inarchive)
+            return E_FAIL;
+        NWindows::NCOM::CPropVariant prop;
+        HRESULT hr = inarchive->GetArchiveProperty(propId, &prop);
+        if (hr != S_OK)
+            return hr;
+        if (prop.vt == VT_EMPTY)
+            return S_FALSE;
+        if (prop.vt == VT_BSTR)
+            propValue = COPYWCHARS(lastStringProperty, prop.bstrVal);
+        else
             return E_FAIL;
         return S_OK;
         // NOTE: alternative implementation
@@ -1049,6 +3244,7 @@ namespace sevenzip {
             return hr;
 
         close();
+        stats.Reset();
 
         if (formatIndex < 0)
             formatIndex = libimpl->getFormatByExtension(getFilenameExt(filename));
@@ -1064,8 +3260,8 @@ namespace sevenzip {
 
         GUID guid = libimpl->getFormatGUID(formatIndex);
 
-        updatecallback = new CUpdateCallback(istream, password);
-        outstream = new COutStream(ostream);
+        updatecallback = new CUpdateCallback(istream, password, &stats);
+        outstream = new COutStream(ostream, &stats);
         return libimpl->CreateObjectFunc(&guid, &IID_IOutArchive, (void**)&outarchive);
     };
     
@@ -1075,6 +3271,7 @@ namespace sevenzip {
         outstream = nullptr;
         updatecallback = nullptr;
         formatIndex = -1;
+        properties = CHandlerProperties();
     };
 
     void Oarchive::Impl::addItem(const wchar_t* pathname) {
@@ -1093,13 +3290,30 @@ namespace sevenzip {
         if (!updatecallback)
             return S_FALSE;
 
-        HRESULT hr = outarchive->UpdateItems(outstream,
+        // NOTE: the handler keeps the last set properties only, all of them are set again with mt;
+        // the properties rejected by the setters are not kept
+        UInt32 used = 0;
+        HRESULT hr = properties.Apply(outarchive, (UInt32)getNumberOfThreads(), used);
+        DEBUGLOG(this << " Oarchive::update mt " << used << " hr " << hr);
+        if (hr != S_OK)
+            return hr;
+        stats.threads.store(used, std::memory_order_relaxed);
+
+        hr = outarchive->UpdateItems(outstream,
             CUPDATECALLBACK(updatecallback)->items.Size(), updatecallback);
         if (hr == S_OK)
             CUPDATECALLBACK(updatecallback)->items.Clear();
         return hr;
     };
 
+    void Oarchive::Impl::getStats(Stats& stats) {
+        this->stats.Get(stats);
+    };
+
+    void Oarchive::Impl::resetStats() {
+        stats.Reset();
+    };
+
     HRESULT Oarchive::Impl::setEmptyProperty(const wchar_t* name) {
         DEBUGLOG(this << " Oarchive::setEmptyProperty " << name);
 
@@ -1107,7 +3321,10 @@ namespace sevenzip {
             return S_FALSE;
 
         NWindows::NCOM::CPropVariant prop;
-        return setProperty(outarchive, name, prop);
+        HRESULT hr = setProperty(outarchive, name, prop);
+        if (hr == S_OK)
+            properties.Set(name, prop);
+        return hr;
     };
 
     HRESULT Oarchive::Impl::setStringProperty(const wchar_t* name, const wchar_t* value) {
@@ -1119,7 +3336,10 @@ namespace sevenzip {
         NWindows::NCOM::CPropVariant prop = L"";
         if (value)            
             prop = value;
-        return setProperty(outarchive, name, prop);
+        HRESULT hr = setProperty(outarchive, name, prop);
+        if (hr == S_OK)
+            properties.Set(name, prop);
+        return hr;
     };
 
     HRESULT Oarchive::Impl::setBoolProperty(const wchar_t* name, bool value) {
@@ -1129,7 +3349,10 @@ namespace sevenzip {
             return S_FALSE;
 
         NWindows::NCOM::CPropVariant prop = value;
-        return setProperty(outarchive, name, prop);
+        HRESULT hr = setProperty(outarchive, name, prop);
+        if (hr == S_OK)
+            properties.Set(name, prop);
+        return hr;
     };
 
     HRESULT Oarchive::Impl::setIntProperty(const wchar_t* name, UInt32 value) {
@@ -1139,7 +3362,10 @@ namespace sevenzip {
             return S_FALSE;
 
         NWindows::NCOM::CPropVariant prop = value;
-        return setProperty(outarchive, name, prop);
+        HRESULT hr = setProperty(outarchive, name, prop);
+        if (hr == S_OK)
+            properties.Set(name, prop);
+        return hr;
     };
 
     HRESULT Oarchive::Impl::setWideProperty(const wchar_t* name, UInt64 value) {
@@ -1149,7 +3375,408 @@ namespace sevenzip {
             return S_FALSE;
 
         NWindows::NCOM::CPropVariant prop = value;
-        return setProperty(outarchive, name, prop);
+        HRESULT hr = setProperty(outarchive, name, prop);
+        if (hr == S_OK)
+            properties.Set(name, prop);
+        return hr;
+    };
+
+    // codecs
+
+    // NOTE: LZMA writes 5 bytes, LZMA2 and Deflate64 at most 1
+    static const UInt32 kCoderPropsMax = 64;
+
+    Codec::Impl::Impl() {
+        DEBUGLOG(this << " Codec::Impl::Impl");
+    };
+
+    Codec::Impl::~Impl() {
+        DEBUGLOG(this << " Codec::Impl::~Impl");
+    };
+
+    HRESULT Codec::Impl::open(Lib::Impl* libimpl, const wchar_t* method) {
+        DEBUGLOG(this << " Codec::open " << (method ? method : L"NULL"));
+
+        close();
+
+        if (!libimpl || !method)
+            return S_FALSE;
+        if (!libimpl->CreateObjectFunc)
+            return S_FALSE;
+
+        int index = libimpl->getMethodByName(method);
+        if (index < 0)
+            return E_NOTSUPPORTED;
+        hasEncoder = libimpl->getMethodCoder(index, true, encoderGuid);
+        hasDecoder = libimpl->getMethodCoder(index, false, decoderGuid);
+        if (!hasEncoder && !hasDecoder)
+            return E_NOTSUPPORTED;
+
+        DEBUGLOG(this << " Codec::open method " << index << " encoder " << hasEncoder << " decoder " << hasDecoder);
+
+        this->libimpl = libimpl;
+        this->method = method;
+        methodIndex = index;
+        return S_OK;
+    };
+
+    void Codec::Impl::close() {
+        DEBUGLOG(this << " Codec::close");
+        encoder = nullptr;
+        decoder = nullptr;
+        libimpl = nullptr;
+        method.Empty();
+        methodIndex = -1;
+        hasEncoder = false;
+        hasDecoder = false;
+        level = (UInt32)(Int32)-1;
+        dictionarySize = 0;
+        numThreads = 0;
+        changed = true;
+        encoderPropsSize = 0;
+        decoderProps.Free();
+        hasDecoderProps = false;
+    };
+
+    HRESULT Codec::Impl::setLevel(UInt32 level) {
+        DEBUGLOG(this << " Codec::setLevel " << level);
+        if (!libimpl)
+            return S_FALSE;
+        if (level > 9)
+            return E_INVALIDARG;
+        this->level = level;
+        changed = true;
+        return S_OK;
+    };
+
+    HRESULT Codec::Impl::setDictionarySize(UInt32 dictionarySize) {
+        DEBUGLOG(this << " Codec::setDictionarySize " << dictionarySize);
+        if (!libimpl)
+            return S_FALSE;
+        this->dictionarySize = dictionarySize;
+        changed = true;
+        return S_OK;
+    };
+
+    HRESULT Codec::Impl::setNumberOfThreads(UInt32 numThreads) {
+        DEBUGLOG(this << " Codec::setNumberOfThreads " << numThreads);
+        if (!libimpl)
+            return S_FALSE;
+        this->numThreads = numThreads;
+        changed = true;
+        return S_OK;
+    };
+
+    HRESULT Codec::Impl::getEncoderProperties(void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        HRESULT hr = prepareEncoder();
+        if (hr != S_OK)
+            return hr;
+        if (encoderPropsSize > size)
+            return E_OUTOFMEMORY;
+        if (encoderPropsSize > 0)
+            memcpy(data, encoderProps, encoderPropsSize);
+        processed = encoderPropsSize;
+        return S_OK;
+    };
+
+    HRESULT Codec::Impl::setDecoderProperties(const void* data, UInt32 size) {
+        DEBUGLOG(this << " Codec::setDecoderProperties " << size);
+        if (!libimpl)
+            return S_FALSE;
+        decoderProps.CopyFrom((const Byte*)data, size);
+        hasDecoderProps = true;
+        return S_OK;
+    };
+
+    UInt32 Codec::Impl::getThreads() const {
+        return numThreads > 0 ? numThreads : (UInt32)getNumberOfThreads();
+    };
+
+    // NOTE: the encoder resets its properties on every call, they are set together and
+    // the coder properties are written again; kNumThreads is dropped if rejected and not set by the caller
+    HRESULT Codec::Impl::prepareEncoder() {
+        if (!libimpl)
+            return S_FALSE;
+        if (!hasEncoder)
+            return E_NOTSUPPORTED;
+        if (!encoder) {
+            HRESULT hr = libimpl->CreateObjectFunc(&encoderGuid, &IID_ICompressCoder, (void**)&encoder);
+            if (hr != S_OK)
+                return hr;
+            if (!encoder)
+                return E_NOTSUPPORTED;
+            changed = true;
+        }
+        if (!changed)
+            return S_OK;
+
+        CMyComPtr<ICompressSetCoderProperties> setter;
+        encoder->QueryInterface(IID_ICompressSetCoderProperties, (void **)&setter);
+        if (setter) {
+            PROPID ids[3];
+            NWindows::NCOM::CPropVariant values[3];
+            UInt32 n = 0;
+            if (level != (UInt32)(Int32)-1) {
+                ids[n] = NCoderPropID::kLevel;
+                values[n++] = level;
+            }
+            if (dictionarySize > 0) {
+                ids[n] = NCoderPropID::kDictionarySize;
+                values[n++] = dictionarySize;
+            }
+            ids[n] = NCoderPropID::kNumThreads;
+            values[n++] = getThreads();
+            HRESULT hr = setter->SetCoderProperties(ids, values, n);
+            if (hr != S_OK && numThreads == 0)
+                hr = setter->SetCoderProperties(ids, values, n - 1);
+            if (hr != S_OK)
+                return hr;
+        }
+
+        encoderPropsSize = 0;
+        CMyComPtr<ICompressWriteCoderProperties> writer;
+        encoder->QueryInterface(IID_ICompressWriteCoderProperties, (void **)&writer);
+        if (writer) {
+            if (encoderProps.Size() < kCoderPropsMax)
+                encoderProps.Alloc(kCoderPropsMax);
+            CBufferOutStream* propstream = new CBufferOutStream(encoderProps, kCoderPropsMax);
+            CMyComPtr<ISequentialOutStream> propstreamPtr = propstream;
+            HRESULT hr = writer->WriteCoderProperties(propstreamPtr);
+            if (hr != S_OK)
+                return hr;
+            encoderPropsSize = propstream->GetPosition();
+        }
+        changed = false;
+        return S_OK;
+    };
+
+    // NOTE: without the decoder properties set, the properties of the encoder of this codec are used
+    HRESULT Codec::Impl::prepareDecoder() {
+        if (!libimpl)
+            return S_FALSE;
+        if (!hasDecoder)
+            return E_NOTSUPPORTED;
+        if (!decoder) {
+            HRESULT hr = libimpl->CreateObjectFunc(&decoderGuid, &IID_ICompressCoder, (void**)&decoder);
+            if (hr != S_OK)
+                return hr;
+            if (!decoder)
+                return E_NOTSUPPORTED;
+        }
+
+        const Byte* props = hasDecoderProps ? (const Byte*)decoderProps : (const Byte*)encoderProps;
+        UInt32 propsSize = hasDecoderProps ? (UInt32)decoderProps.Size() : encoderPropsSize;
+        if (hasDecoderProps || propsSize > 0) {
+            CMyComPtr<ICompressSetDecoderProperties2> setter;
+            decoder->QueryInterface(IID_ICompressSetDecoderProperties2, (void **)&setter);
+            if (!setter)
+                return propsSize > 0 ? E_NOTSUPPORTED : S_OK;
+            HRESULT hr = setter->SetDecoderProperties2(props, propsSize);
+            if (hr != S_OK)
+                return hr;
+        }
+
+        CMyComPtr<ICompressSetCoderMt> mt;
+        decoder->QueryInterface(IID_ICompressSetCoderMt, (void **)&mt);
+        if (mt)
+            mt->SetNumberOfThreads(getThreads());
+        return S_OK;
+    };
+
+    HRESULT Codec::Impl::encode(ISequentialInStream* instream, ISequentialOutStream* outstream, const UInt64* inSize) {
+        HRESULT hr = prepareEncoder();
+        if (hr != S_OK)
+            return hr;
+        hr = encoder->Code(instream, outstream, inSize, nullptr, nullptr);
+        DEBUGLOG(this << " Codec::encode hr " << hr);
+        return hr;
+    };
+
+    HRESULT Codec::Impl::decode(ISequentialInStream* instream, ISequentialOutStream* outstream, const UInt64* outSize) {
+        HRESULT hr = prepareDecoder();
+        if (hr != S_OK)
+            return hr;
+        hr = decoder->Code(instream, outstream, nullptr, outSize, nullptr);
+        DEBUGLOG(this << " Codec::decode hr " << hr);
+        return hr;
+    };
+
+    HRESULT Codec::Impl::encode(Istream* istream, Ostream* ostream, UInt64 inSize) {
+        DEBUGLOG(this << " Codec::encode " << istream << " " << ostream << " " << inSize);
+        if (!istream || !ostream)
+            return S_FALSE;
+        CMyComPtr<ISequentialInStream> instream = new CInStream(istream);
+        CMyComPtr<ISequentialOutStream> outstream = new COutStream(ostream);
+        return encode(instream, outstream, inSize == (UInt64)(Int64)-1 ? nullptr : &inSize);
+    };
+
+    HRESULT Codec::Impl::decode(Istream* istream, Ostream* ostream, UInt64 outSize) {
+        DEBUGLOG(this << " Codec::decode " << istream << " " << ostream << " " << outSize);
+        if (!istream || !ostream)
+            return S_FALSE;
+        CMyComPtr<ISequentialInStream> instream = new CInStream(istream);
+        CMyComPtr<ISequentialOutStream> outstream = new COutStream(ostream);
+        return decode(instream, outstream, outSize == (UInt64)(Int64)-1 ? nullptr : &outSize);
+    };
+
+    HRESULT Codec::Impl::encode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed) {
+        DEBUGLOG(this << " Codec::encode " << inSize << " " << outSize);
+        processed = 0;
+        if ((!in && inSize > 0) || (!out && outSize > 0))
+            return S_FALSE;
+        CBufferOutStream* outbuffer = new CBufferOutStream(out, outSize);
+        CMyComPtr<ISequentialInStream> instream = new CBufferInStream(in, inSize);
+        CMyComPtr<ISequentialOutStream> outstream = outbuffer;
+        UInt64 size = inSize;
+        HRESULT hr = encode(instream, outstream, &size);
+        processed = outbuffer->GetPosition();
+        return hr;
+    };
+
+    // NOTE: the output size is not known, the decoder stops at the end of the input or at the end marker
+    HRESULT Codec::Impl::decode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed) {
+        DEBUGLOG(this << " Codec::decode " << inSize << " " << outSize);
+        processed = 0;
+        if ((!in && inSize > 0) || (!out && outSize > 0))
+            return S_FALSE;
+        CBufferOutStream* outbuffer = new CBufferOutStream(out, outSize);
+        CMyComPtr<ISequentialInStream> instream = new CBufferInStream(in, inSize);
+        CMyComPtr<ISequentialOutStream> outstream = outbuffer;
+        HRESULT hr = decode(instream, outstream, nullptr);
+        processed = outbuffer->GetPosition();
+        return hr;
+    };
+
+    // NOTE: false if the codec is closed or opened with another library
+    bool Codec::Impl::getKey(const Lib::Impl* libimpl, CCodecKey& key) const {
+        if (!this->libimpl || this->libimpl != libimpl)
+            return false;
+        key.method = method;
+        key.level = level;
+        key.dictionarySize = dictionarySize;
+        key.numThreads = numThreads;
+        return true;
+    };
+
+    // NOTE: the coders and the encoder properties are kept, the next decode uses the encoder properties
+    void Codec::Impl::reset() {
+        decoderProps.Free();
+        hasDecoderProps = false;
+    };
+
+    // codec pool
+
+    CodecPool::Impl::Impl() {
+        DEBUGLOG(this << " CodecPool::Impl::Impl");
+    };
+
+    CodecPool::Impl::~Impl() {
+        DEBUGLOG(this << " CodecPool::Impl::~Impl");
+        close();
+    };
+
+    HRESULT CodecPool::Impl::open(Lib::Impl* libimpl, UInt32 maxIdle) {
+        DEBUGLOG(this << " CodecPool::open " << maxIdle);
+
+        close();
+
+        if (!libimpl || !libimpl->CreateObjectFunc)
+            return S_FALSE;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        this->libimpl = libimpl;
+        this->maxIdle = maxIdle;
+        hits = 0;
+        misses = 0;
+        return S_OK;
+    };
+
+    void CodecPool::Impl::close() {
+        DEBUGLOG(this << " CodecPool::close");
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned i = 0; i < entries.Size(); i++)
+            for (unsigned j = 0; j < entries[i].idle.Size(); j++)
+                delete entries[i].idle[j];
+        entries.Clear();
+        libimpl = nullptr;
+    };
+
+    // NOTE: a miss opens the codec under the lock, the method lookup uses the name buffer of the library
+    HRESULT CodecPool::Impl::acquire(const wchar_t* method, Codec*& codec,
+            UInt32 level, UInt32 dictionarySize, UInt32 numThreads) {
+        codec = nullptr;
+        if (!method)
+            return S_FALSE;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!libimpl)
+            return S_FALSE;
+        for (unsigned i = 0; i < entries.Size(); i++) {
+            CEntry& entry = entries[i];
+            if (!entry.idle.IsEmpty() && entry.key.Matches(method, level, dictionarySize, numThreads)) {
+                codec = entry.idle.Back();
+                entry.idle.DeleteBack();
+                hits++;
+                return S_OK;
+            }
+        }
+        misses++;
+
+        Codec* created = new Codec();
+        HRESULT hr = created->pimpl->open(libimpl, method);
+        if (hr == S_OK && level != (UInt32)(Int32)-1)
+            hr = created->pimpl->setLevel(level);
+        if (hr == S_OK && dictionarySize > 0)
+            hr = created->pimpl->setDictionarySize(dictionarySize);
+        if (hr == S_OK && numThreads > 0)
+            hr = created->pimpl->setNumberOfThreads(numThreads);
+        DEBUGLOG(this << " CodecPool::acquire created " << method << " hr " << hr);
+        if (hr != S_OK) {
+            delete created;
+            return hr;
+        }
+        codec = created;
+        return S_OK;
+    };
+
+    void CodecPool::Impl::release(Codec* codec) {
+        if (!codec)
+            return;
+        codec->pimpl->reset();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        unsigned limit = maxIdle > 0 ? maxIdle : (unsigned)getNumberOfThreads();
+        CCodecKey key;
+        if (libimpl && codec->pimpl->getKey(libimpl, key)) {
+            unsigned i = 0;
+            for (; i < entries.Size(); i++)
+                if (entries[i].key.Matches(key.method, key.level, key.dictionarySize, key.numThreads))
+                    break;
+            if (i == entries.Size())
+                entries.AddNew().key = key;
+            if (entries[i].idle.Size() < limit) {
+                entries[i].idle.Add(codec);
+                return;
+            }
+        }
+        lock.unlock();
+        delete codec;
+    };
+
+    void CodecPool::Impl::getStats(PoolStats& stats) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.idle = 0;
+        for (unsigned i = 0; i < entries.Size(); i++)
+            stats.idle += entries[i].idle.Size();
+    };
+
+    void CodecPool::Impl::resetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        hits = 0;
+        misses = 0;
     };
 
     // library
@@ -1175,6 +3802,7 @@ namespace sevenzip {
 #endif
             lib = nullptr;
         }
+        clearRegistry();
     };
 
     // NOTE: used internally instead of incomplete unload
@@ -1188,6 +3816,7 @@ namespace sevenzip {
 #endif
             lib = nullptr;
         }
+        clearRegistry();
     }
 
 
@@ -1230,7 +3859,8 @@ namespace sevenzip {
             GetHandlerProperty2 = (Func_GetHandlerProperty2)GetProcAddress("GetHandlerProperty2");
             if (!GetHandlerProperty2)
                 break;
-            DEBUGLOG(this << " Lib::Impl::Load success : " << lib);
+            buildRegistry();
+            DEBUGLOG(this << " Lib::Impl::Load success : " << lib << " formats " << formats.Size());
             return true;
         } while (0);
 #ifdef _WIN32
@@ -1291,6 +3921,45 @@ namespace sevenzip {
         return lastMethodName;
     };
 
+    UInt64 Lib::Impl::getMethodId(int index) {
+        NWindows::NCOM::CPropVariant prop;
+        if (!GetMethodProperty)
+            return 0;
+        if (GetMethodProperty(index, NMethodPropID::kID, &prop) != S_OK)
+            return 0;
+        if (prop.vt != VT_UI8)
+            return 0;
+        return prop.uhVal.QuadPart;
+    };
+
+    int Lib::Impl::getMethodByName(const wchar_t* name) {
+        if (!name)
+            return -1;
+        int n = getNumberOfMethods();
+        for (int i = 0; i < n; i++) {
+            const wchar_t* method = getMethodName(i);
+            size_t j = 0;
+            while (method[j] && towlower(method[j]) == towlower(name[j]))
+                j++;
+            if (method[j] == L'\0' && name[j] == L'\0')
+                return i;
+        }
+        return -1;
+    };
+
+    // NOTE: the class IDs are stored as 16 bytes strings
+    bool Lib::Impl::getMethodCoder(int index, bool encoder, GUID& clsid) {
+        NWindows::NCOM::CPropVariant prop;
+        if (!GetMethodProperty)
+            return false;
+        if (GetMethodProperty(index, encoder ? NMethodPropID::kEncoder : NMethodPropID::kDecoder, &prop) != S_OK)
+            return false;
+        if (prop.vt != VT_BSTR || SysStringByteLen(prop.bstrVal) != sizeof(GUID))
+            return false;
+        memcpy(&clsid, prop.bstrVal, sizeof(GUID));
+        return true;
+    };
+
     // NOTE: usable props - kDecoderIsAssigned, kEncoderIsAssigned, kIsFilter
     // bool Lib::Impl::getMethodIsEncoder(int index) {
     //     NWindows::NCOM::CPropVariant prop;
@@ -1304,57 +3973,50 @@ namespace sevenzip {
     // };
 
     int Lib::Impl::getNumberOfFormats() {
-        UInt32 n = 1;
-        if (!GetNumberOfFormats)
-            return 0;
-        if (GetNumberOfFormats(&n) != S_OK)
-            return 0;
-        return n;
+        return formats.Size();
     };
 
     wchar_t* Lib::Impl::getFormatExtensions(int index) {
         lastFormatExtensions[0] = L'\0';
-        NWindows::NCOM::CPropVariant prop;
-        if (!GetHandlerProperty2)
-            return lastFormatExtensions;
-        if (GetHandlerProperty2(index, NArchive::NHandlerPropID::kExtension, &prop) != S_OK)
+        if (index < 0 || (unsigned)index >= formats.Size())
             return lastFormatExtensions;
-        if (prop.vt != VT_BSTR)
-            return lastFormatExtensions;
-        COPYWCHARS(lastFormatExtensions, prop.bstrVal);
+        COPYWCHARS(lastFormatExtensions, formats[index].extensions.Ptr());
         return lastFormatExtensions;
     };
 
     wchar_t* Lib::Impl::getFormatName(int index) {
         lastFormatName[0] = L'\0';
-        NWindows::NCOM::CPropVariant prop;
-        if (!GetHandlerProperty2)
-            return lastFormatName;
-        if (GetHandlerProperty2(index, NArchive::NHandlerPropID::kName, &prop) != S_OK)
-            return lastFormatName;
-        if (prop.vt != VT_BSTR)
+        if (index < 0 || (unsigned)index >= formats.Size())
             return lastFormatName;
-        COPYWCHARS(lastFormatName, prop.bstrVal);
+        COPYWCHARS(lastFormatName, formats[index].name.Ptr());
         return lastFormatName;
     };
 
     bool Lib::Impl::getFormatUpdatable(int index) {
-        NWindows::NCOM::CPropVariant prop;
-        if (!GetHandlerProperty2)
-            return false;
-        if (GetHandlerProperty2(index, NArchive::NHandlerPropID::kUpdate, &prop) != S_OK)
-            return false;
-        if (prop.vt != VT_BOOL)
+        if (index < 0 || (unsigned)index >= formats.Size())
             return false;
-        return prop.boolVal;
+        return formats[index].updatable;
+    };
+
+    static const UInt32 kSignatureHeadSizeMax = (UInt32)1 << 20;
+    static const UInt32 kSignatureTailSize = 512;
+
+    static UInt32 getExtensionHash(const wchar_t* ext) {
+        UInt32 hash = 2166136261u;
+        for (; *ext; ext++)
+            hash = (hash ^ (UInt32)*ext) * 16777619u;
+        return hash;
     };
 
     int Lib::Impl::getFormatByExtension(const wchar_t* ext) {
-        if (!ext)
+        if (!ext || extensionBuckets.IsEmpty())
             return -1;
-        for (int i = 0; i < getNumberOfFormats(); i++) {
-            if (isExtensionSupported(i, ext))
-                return i;
+        UInt32 hash = getExtensionHash(ext);
+        int e = extensionBuckets[hash & (extensionBuckets.Size() - 1)];
+        for (; e >= 0; e = extensions[e].next) {
+            const CExtensionEntry& entry = extensions[e];
+            if (entry.hash == hash && wcscmp(formats[entry.formatIndex].exts[entry.extIndex], ext) == 0)
+                return entry.formatIndex;
         }
         return -1;
     };
@@ -1365,127 +4027,419 @@ namespace sevenzip {
     };
 
     int Lib::Impl::getFormatBySignature(IInStream* stream, const wchar_t* ext) {
-        if (!GetHandlerProperty2)
+        CRecordVector<int> candidates;
+        CRecordVector<UInt32> lengths;
+        if (!matchSignatures(stream, ext, candidates, lengths) || candidates.IsEmpty())
             return -1;
-        UInt64 pos = 0, end;
-        UInt32 bufsize = 2048;
-        CByteBuffer buf(bufsize);
-        buf.Wipe();
+        return candidates[0];
+    };
+
+    static int compareCandidates(const unsigned* a, const unsigned* b, void* param) {
+        const CRecordVector<UInt32>& lengths = *(const CRecordVector<UInt32>*)param;
+        if (lengths[*a] != lengths[*b])
+            return lengths[*a] > lengths[*b] ? -1 : 1;
+        return *a < *b ? -1 : (*a > *b ? 1 : 0);
+    };
+
+    // NOTE: longer signature matches go first, extension only matches go last
+    int Lib::Impl::getFormatsBySignature(Istream* stream, int* formats, int maxFormats, const wchar_t* ext) {
+        if (!formats || maxFormats <= 0)
+            return 0;
+        CInStream instream(stream);
+        CRecordVector<int> candidates;
+        CRecordVector<UInt32> lengths;
+        if (!matchSignatures(&instream, ext, candidates, lengths))
+            return 0;
+        CRecordVector<unsigned> order;
+        order.ClearAndReserve(candidates.Size());
+        for (unsigned i = 0; i < candidates.Size(); i++)
+            order.AddInReserved(i);
+        order.Sort(compareCandidates, &lengths);
+        int n = 0;
+        for (; n < maxFormats && (unsigned)n < order.Size(); n++)
+            formats[n] = candidates[order[n]];
+        return n;
+    };
+
+    static HRESULT readStream(ISequentialInStream* stream, void* data, UInt32 size, UInt32& processed) {
+        processed = 0;
+        while (processed < size) {
+            UInt32 n = 0;
+            HRESULT hr = stream->Read((Byte*)data + processed, size - processed, &n);
+            if (hr != S_OK)
+                return hr;
+            if (n == 0)
+                break;
+            processed += n;
+        }
+        return S_OK;
+    };
+
+    // NOTE: head and tail windows are read once, candidates are in the format order,
+    // zero length candidate is a format without signature matching the extension
+    bool Lib::Impl::matchSignatures(IInStream* stream, const wchar_t* ext,
+            CRecordVector<int>& candidates, CRecordVector<UInt32>& lengths) {
+        candidates.Clear();
+        lengths.Clear();
+        if (formats.IsEmpty())
+            return false;
+
+        UInt64 pos = 0, end = 0;
         if (stream->Seek(0, SZ_SEEK_CUR, &pos) != S_OK)
-            return -1;
+            return false;
         if (stream->Seek(0, SZ_SEEK_END, &end) != S_OK)
-            return -1;
-        if (stream->Seek(0, SZ_SEEK_SET, nullptr) != S_OK)
-            return -1;
-        if (stream->Read(buf, bufsize, nullptr) != S_OK)
-            return -1;
+            return false;
+
+        CByteBuffer head(signatureHeadSize);
+        head.Wipe();
+        UInt32 headread = 0;
+        if (signatureHeadSize > 0) {
+            if (stream->Seek(0, SZ_SEEK_SET, nullptr) != S_OK)
+                return false;
+            if (readStream(stream, head, signatureHeadSize, headread) != S_OK)
+                return false;
+        }
+
+        CByteBuffer tail;
+        const Byte* tailptr = nullptr;
+        if (signatureTailSize > 0 && end >= signatureTailSize) {
+            if (end <= headread) {
+                tailptr = (const Byte*)head + (size_t)(end - signatureTailSize);
+            } else {
+                UInt32 tailread = 0;
+                tail.Alloc(signatureTailSize);
+                tail.Wipe();
+                if (stream->Seek(-(Int64)signatureTailSize, SZ_SEEK_END, nullptr) != S_OK)
+                    return false;
+                if (readStream(stream, tail, signatureTailSize, tailread) != S_OK)
+                    return false;
+                tailptr = tail;
+            }
+        }
         if (stream->Seek(pos, SZ_SEEK_SET, nullptr) != S_OK)
-            return -1;
-        CByteBuffer buf2; // dynamic buffer
+            return false;
+
+        DEBUGLOG(this << " Lib::Impl::matchSignatures head " << headread << " tail " << (tailptr != nullptr));
 
-        for (int i = 0; i < getNumberOfFormats(); i++) {
-            // DEBUGLOG(this << " Lib::Impl::getFormatBySignature checking format " << i << " "
-            //     << getFormatName(i) << " ext " << (ext ? ext : L"NULL"));
+        CRecordVector<UInt32> best;
+        best.ClearAndReserve(formats.Size());
+        for (unsigned i = 0; i < formats.Size(); i++)
+            best.AddInReserved(0);
 
+        for (unsigned g = 0; g < signatureGroups.Size(); g++) {
+            const CSignatureGroup& group = signatureGroups[g];
+            const Byte* window = group.tail ? tailptr : (const Byte*)head;
+            UInt64 avail = group.tail ? signatureTailSize : (end < signatureHeadSize ? end : signatureHeadSize);
+            if (!window || group.offset >= avail)
+                continue;
+            int e = group.buckets[window[group.offset]];
+            for (; e >= 0; e = signatureEntries[e].next) {
+                const CSignatureEntry& entry = signatureEntries[e];
+                const CByteBuffer& sign = formats[entry.formatIndex].signatures[entry.signatureIndex];
+                if (group.offset + sign.Size() > avail)
+                    continue;
+                if (best[entry.formatIndex] >= sign.Size())
+                    continue;
+                if (memcmp(sign, window + group.offset, sign.Size()) == 0)
+                    best[entry.formatIndex] = (UInt32)sign.Size();
+            }
+        }
+
+        bool hasext = ext && ext[0];
+        for (unsigned i = 0; i < formats.Size(); i++) {
             // restrict detection to a given extension if is not empty
-            if (ext && ext[0] && !isExtensionSupported(i, ext))
+            if (hasext && !isExtensionSupported(i, ext))
                 continue;
+            // signature not defined, the format matches the extension
+            if (best[i] > 0 || (hasext && formats[i].signatures.IsEmpty())) {
+                candidates.Add((int)i);
+                lengths.Add(best[i]);
+            }
+        }
+        return true;
+    };
 
-            NWindows::NCOM::CPropVariant prop, prop1, prop2;
-            UINT len1 = 0, len2 = 0;
-            ULONG offs = 0;
+    GUID Lib::Impl::getFormatGUID(int index) const {
+        if (index < 0 || (unsigned)index >= formats.Size())
+            return IID_IUnknown;
+        return formats[index].guid;
+    };
 
-            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kSignatureOffset, &prop) == S_OK)
-                if (prop.vt == VT_UI4)
-                    offs = prop.ulVal;
-            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kSignature, &prop1) == S_OK)
-                if (prop1.vt == VT_BSTR)
-                    len1 = SysStringByteLen(prop1.bstrVal);
-            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kMultiSignature, &prop2) == S_OK)
-                if (prop2.vt == VT_BSTR)
-                    len2 = SysStringByteLen(prop2.bstrVal);
-
-            DEBUGLOG(this << " Lib::Impl::getFormatBySignature " << i << " " << offs << "/" << len1 << "/" <<  len2);
-            
-            // signature not defined, return the first format that matches the extension
-            if (ext && ext[0] && len1 == 0 && len2 == 0)
-                return i;
+    bool Lib::Impl::isExtensionSupported(int index, const wchar_t* ext) const {
+        if (!ext || index < 0 || (unsigned)index >= formats.Size())
+            return false;
+        const UStringVector& exts = formats[index].exts;
+        for (unsigned i = 0; i < exts.Size(); i++)
+            if (wcscmp(exts[i], ext) == 0)
+                return true;
+        return false;
+    };
 
-            CByteBuffer *bufptr = &buf;
-            bool isdmg = getFormatGUID(i).Data4[5] == 0xE4;
+    static const UInt32 kEmbeddedBlockSize = (UInt32)1 << 20;
+    static const unsigned kEmbeddedSignatureSizeMin = 3;
 
-            // process dmg or other format with signature after first 2048 bytes (iso, udf)
-            if (offs + max(len1, len2) > bufsize || isdmg) {
+    struct CEmbeddedEntry {
+        int formatIndex;
+        unsigned signatureIndex;
+        UInt32 offset;
+        int next;
+    };
 
-                DEBUGLOG(this << " Lib::Impl::getFormatBySignature " << i << " using dynamic buffer, isdmg " << isdmg);
+    // NOTE: the stream is read in blocks keeping an overlap for signatures crossing
+    // the block boundary, positions are filtered by the two byte signature prefix bitmap
+    // and only signatures starting with the byte found are compared
+    int Lib::Impl::findEmbeddedArchives(Istream* stream, EmbeddedArchive* archives, int maxArchives, UInt64 maxScanBytes) {
+        if (!archives || maxArchives <= 0 || formats.IsEmpty())
+            return 0;
 
-                if (isdmg) {
-                    if (end < 512)
+        CRecordVector<CEmbeddedEntry> entries;
+        int buckets[256];
+        for (unsigned b = 0; b < 256; b++)
+            buckets[b] = -1;
+        CByteBuffer prefixes((size_t)1 << 13);
+        prefixes.Wipe();
+        UInt32 maxsize = 0;
+
+        for (unsigned i = 0; i < formats.Size(); i++) {
+            const CFormatInfo& format = formats[i];
+            // dmg signature is at the end of the archive
+            if (format.guid.Data4[5] == 0xE4)
+                continue;
+            for (unsigned j = 0; j < format.signatures.Size(); j++) {
+                const CByteBuffer& sign = format.signatures[j];
+                // short signatures give too many false candidates
+                if (sign.Size() < kEmbeddedSignatureSizeMin || sign.Size() > kSignatureTailSize)
+                    continue;
+                CEmbeddedEntry entry;
+                entry.formatIndex = (int)i;
+                entry.signatureIndex = j;
+                entry.offset = format.signatureOffset;
+                entry.next = -1;
+                int e = entries.Add(entry);
+                int* link = &buckets[sign[0]];
+                while (*link >= 0)
+                    link = &entries[*link].next;
+                *link = e;
+                unsigned prefix = ((unsigned)sign[0] << 8) | sign[1];
+                prefixes[prefix >> 3] |= (Byte)(1 << (prefix & 7));
+                maxsize = max(maxsize, (UInt32)sign.Size());
+            }
+        }
+        if (entries.IsEmpty())
+            return 0;
+
+        CInStream instream(stream);
+        UInt64 pos = 0;
+        if (instream.Seek(0, SZ_SEEK_CUR, &pos) != S_OK)
+            return 0;
+        if (instream.Seek(0, SZ_SEEK_SET, nullptr) != S_OK)
+            return 0;
+
+        const UInt32 overlap = maxsize - 1;
+        CByteBuffer buffer(kEmbeddedBlockSize + overlap);
+        const Byte* p = buffer;
+        UInt64 base = 0;
+        UInt32 filled = 0;
+        int n = 0;
+        while (n < maxArchives) {
+            UInt32 size = kEmbeddedBlockSize;
+            if (maxScanBytes > 0 && maxScanBytes - (base + filled) < size)
+                size = (UInt32)(maxScanBytes - (base + filled));
+            UInt32 processed = 0;
+            if (readStream(&instream, buffer + filled, size, processed) != S_OK)
+                break;
+            filled += processed;
+            bool last = processed < kEmbeddedBlockSize;
+            // the overlap is checked with the next block
+            UInt32 limit = last ? filled : filled - overlap;
+
+            for (UInt32 i = 0; i + 1 < filled && i < limit && n < maxArchives; i++) {
+                unsigned prefix = ((unsigned)p[i] << 8) | p[i + 1];
+                if (!(prefixes[prefix >> 3] & (1 << (prefix & 7))))
+                    continue;
+                int first = n;
+                for (int e = buckets[p[i]]; e >= 0 && n < maxArchives; e = entries[e].next) {
+                    const CEmbeddedEntry& entry = entries[e];
+                    const CByteBuffer& sign = formats[entry.formatIndex].signatures[entry.signatureIndex];
+                    if (i + sign.Size() > filled || base + i < entry.offset)
                         continue;
-                    if (stream->Seek(-512, SZ_SEEK_END, nullptr) != S_OK)
-                        return -1;
-                } else {
-                    if (end < offs + max(len1, len2))
+                    if (memcmp(sign, p + i, sign.Size()) != 0)
                         continue;
-                    if (stream->Seek(offs, SZ_SEEK_SET, nullptr) != S_OK)
-                        return -1;
+                    UInt64 offset = base + i - entry.offset;
+                    int k = first;
+                    for (; k < n; k++)
+                        if (archives[k].offset == offset && archives[k].formatIndex == entry.formatIndex)
+                            break;
+                    if (k < n)
+                        continue;
+                    archives[n].offset = offset;
+                    archives[n].formatIndex = entry.formatIndex;
+                    n++;
                 }
-                buf2.AllocAtLeast(max(max(len1, len2), 64));
-                buf2.Wipe();
-                if (stream->Read(buf2, max(len1, len2), nullptr) != S_OK)
-                    return -1;
-                if (stream->Seek(pos, SZ_SEEK_SET, nullptr) != S_OK)
-                    return -1;
-                bufptr = &buf2;
-                offs = 0;
             }
-            if (len1 > 0) {
-                if (memcmp(prop1.bstrVal, *bufptr + offs, len1) == 0)
-                    return i;
+            if (last)
+                break;
+            memmove(buffer, p + limit, filled - limit);
+            base += limit;
+            filled -= limit;
+        }
+
+        DEBUGLOG(this << " Lib::Impl::findEmbeddedArchives scanned " << (base + filled) << " found " << n);
+
+        instream.Seek((Int64)pos, SZ_SEEK_SET, nullptr);
+        return n;
+    };
+
+    void Lib::Impl::buildRegistry() {
+        clearRegistry();
+        UInt32 n = 0;
+        if (!GetNumberOfFormats || !GetHandlerProperty2)
+            return;
+        if (GetNumberOfFormats(&n) != S_OK)
+            return;
+
+        formats.ClearAndReserve(n);
+        for (UInt32 i = 0; i < n; i++) {
+            CFormatInfo format;
+            format.name = getStringProperty(i, NArchive::NHandlerPropID::kName);
+            format.extensions = getStringProperty(i, NArchive::NHandlerPropID::kExtension);
+            format.guid = IID_IUnknown;
+            format.updatable = false;
+            format.signatureOffset = 0;
+
+            UString ext;
+            for (unsigned c = 0; c <= format.extensions.Len(); c++) {
+                wchar_t ch = format.extensions[c];
+                if (ch != L' ' && ch != L'\0') {
+                    ext += ch;
+                } else if (!ext.IsEmpty()) {
+                    format.exts.Add(ext);
+                    ext.Empty();
+                }
             }
-            if (len2 > 0) {
-                auto sign = reinterpret_cast<const Byte*>(prop2.bstrVal);
-                auto rest = len2;
-                while (rest > 0) {
-                    const unsigned len = *sign++;
-                    rest--;
-                    if (len > rest)
-                        break;
-                    if (len > 0 && memcmp(sign, *bufptr + offs, len) == 0)
-                        return i;
-                    sign += len;
-                    rest -= len;
+
+            NWindows::NCOM::CPropVariant prop;
+            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kClassID, &prop) == S_OK)
+                if (prop.vt == VT_BSTR && SysStringByteLen(prop.bstrVal) == sizeof(GUID))
+                    format.guid = *(const GUID*)(const void*)prop.bstrVal;
+            prop.Clear();
+            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kUpdate, &prop) == S_OK)
+                if (prop.vt == VT_BOOL)
+                    format.updatable = prop.boolVal != VARIANT_FALSE;
+            prop.Clear();
+            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kSignatureOffset, &prop) == S_OK)
+                if (prop.vt == VT_UI4)
+                    format.signatureOffset = prop.ulVal;
+            prop.Clear();
+            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kSignature, &prop) == S_OK) {
+                if (prop.vt == VT_BSTR && SysStringByteLen(prop.bstrVal) > 0) {
+                    CByteBuffer sign;
+                    sign.CopyFrom((const Byte*)prop.bstrVal, SysStringByteLen(prop.bstrVal));
+                    format.signatures.Add(sign);
+                }
+            }
+            prop.Clear();
+            if (GetHandlerProperty2(i, NArchive::NHandlerPropID::kMultiSignature, &prop) == S_OK) {
+                if (prop.vt == VT_BSTR) {
+                    auto sign = reinterpret_cast<const Byte*>(prop.bstrVal);
+                    auto rest = SysStringByteLen(prop.bstrVal);
+                    while (rest > 0) {
+                        const unsigned len = *sign++;
+                        rest--;
+                        if (len > rest)
+                            break;
+                        if (len > 0) {
+                            CByteBuffer multisign;
+                            multisign.CopyFrom(sign, len);
+                            format.signatures.Add(multisign);
+                        }
+                        sign += len;
+                        rest -= len;
+                    }
                 }
             }
+            formats.Add(format);
+        }
 
-            // DEBUGLOG(this << " Lib::Impl::getFormatBySignature " << i << " not detected ");
+        for (unsigned i = 0; i < formats.Size(); i++) {
+            for (unsigned j = 0; j < formats[i].exts.Size(); j++) {
+                CExtensionEntry entry;
+                entry.hash = getExtensionHash(formats[i].exts[j]);
+                entry.formatIndex = (int)i;
+                entry.extIndex = j;
+                entry.next = -1;
+                extensions.Add(entry);
+            }
         }
-        return -1;
-    };
 
-    GUID Lib::Impl::getFormatGUID(int index) {
-        NWindows::NCOM::CPropVariant prop;
-        if (!GetHandlerProperty2)
-            return IID_IUnknown;
-        if (GetHandlerProperty2(index, NArchive::NHandlerPropID::kClassID, &prop) != S_OK)
-            return IID_IUnknown;
-        if (prop.vt != VT_BSTR)
-            return IID_IUnknown;
-        if (SysStringByteLen(prop.bstrVal) != sizeof(GUID))
-            return IID_IUnknown;
-        return *(const GUID*)(const void*)prop.bstrVal;
-    };
+        // process dmg at the end and other formats at their offsets (iso, udf) from the same windows
+        for (unsigned i = 0; i < formats.Size(); i++) {
+            const CFormatInfo& format = formats[i];
+            bool isdmg = format.guid.Data4[5] == 0xE4;
+            UInt32 offset = isdmg ? 0 : format.signatureOffset;
+            for (unsigned j = 0; j < format.signatures.Size(); j++) {
+                const CByteBuffer& sign = format.signatures[j];
+                if (isdmg) {
+                    if (sign.Size() > kSignatureTailSize)
+                        continue;
+                    signatureTailSize = kSignatureTailSize;
+                } else {
+                    if (offset + sign.Size() > kSignatureHeadSizeMax)
+                        continue;
+                    signatureHeadSize = max(signatureHeadSize, offset + (UInt32)sign.Size());
+                }
+                unsigned g = 0;
+                for (; g < signatureGroups.Size(); g++)
+                    if (signatureGroups[g].offset == offset && signatureGroups[g].tail == isdmg)
+                        break;
+                if (g == signatureGroups.Size()) {
+                    CSignatureGroup group;
+                    group.offset = offset;
+                    group.tail = isdmg;
+                    for (unsigned b = 0; b < 256; b++)
+                        group.buckets[b] = -1;
+                    signatureGroups.Add(group);
+                }
+                CSignatureEntry entry;
+                entry.formatIndex = (int)i;
+                entry.signatureIndex = j;
+                entry.next = -1;
+                int e = signatureEntries.Add(entry);
+                int* link = &signatureGroups[g].buckets[sign[0]];
+                while (*link >= 0)
+                    link = &signatureEntries[*link].next;
+                *link = e;
+            }
+        }
 
-    bool Lib::Impl::isExtensionSupported(int index, const wchar_t* ext) {    
-        wchar_t* exts = getFormatExtensions(index);
-        wchar_t* state;
-        wchar_t* token = wcstok(exts, L" ", &state);
-        while (token) {
-            if (wcscmp(token, ext) == 0)
-                return true;
-            token = wcstok(NULL, L" ", &state);
+        unsigned nbuckets = 16;
+        while (nbuckets < extensions.Size() * 2)
+            nbuckets <<= 1;
+        CRecordVector<int> tails;
+        extensionBuckets.ClearAndReserve(nbuckets);
+        tails.ClearAndReserve(nbuckets);
+        for (unsigned i = 0; i < nbuckets; i++) {
+            extensionBuckets.AddInReserved(-1);
+            tails.AddInReserved(-1);
         }
-        return false;
+        for (unsigned e = 0; e < extensions.Size(); e++) {
+            unsigned bucket = extensions[e].hash & (nbuckets - 1);
+            if (tails[bucket] < 0)
+                extensionBuckets[bucket] = (int)e;
+            else
+                extensions[tails[bucket]].next = (int)e;
+            tails[bucket] = (int)e;
+        }
+    };
+
+    void Lib::Impl::clearRegistry() {
+        formats.Clear();
+        extensions.Clear();
+        extensionBuckets.Clear();
+        signatureGroups.Clear();
+        signatureEntries.Clear();
+        signatureHeadSize = 0;
+        signatureTailSize = 0;
     };
 
     UString Lib::Impl::getStringProperty(int propIndex, PROPID propID) {
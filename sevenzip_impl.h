@@ -18,11 +18,24 @@
 #include "CPP/7zip/ICoder.h"
 #include "CPP/7zip/IPassword.h"
 #include "CPP/7zip/Archive/IArchive.h"
+#include "CPP/Windows/PropVariant.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #ifndef _WIN32
 typedef void * HMODULE;
 #endif
 
+struct io_uring_params;
+struct io_uring_sqe;
+
 #include "sevenzip_compat.h"
 #include "sevenzip.h"
 
@@ -32,6 +45,96 @@ typedef void * HMODULE;
 
 namespace sevenzip {
 
+    // NOTE: shared by the stream wrappers of one archive, the counters are updated from the worker threads
+    struct CStreamStats {
+
+        std::atomic<UInt64> reads{0};
+        std::atomic<UInt64> readBytes{0};
+        std::atomic<UInt64> writes{0};
+        std::atomic<UInt64> writeBytes{0};
+        std::atomic<UInt64> seeks{0};
+        std::atomic<UInt64> seeksElided{0};
+        std::atomic<UInt64> readAheadHits{0};
+        std::atomic<UInt64> readAheadMisses{0};
+        std::atomic<UInt64> skips{0};
+        std::atomic<UInt64> skipBytes{0};
+        std::atomic<UInt64> copies{0};
+        std::atomic<UInt64> copyBytes{0};
+        // NOTE: the mt value set on the handler, kept by Reset
+        std::atomic<UInt64> threads{0};
+
+        void Get(Stats& stats) const;
+        void Add(const CStreamStats& other);
+        void Reset();
+    };
+
+    // NOTE: handler properties kept to be set by one ISetProperties call, the handlers
+    // reset their properties on every call
+    class CHandlerProperties {
+
+    public:
+
+        HRESULT Set(const wchar_t* name, const NWindows::NCOM::CPropVariant& prop);
+        bool Has(const wchar_t* name) const;
+
+        // NOTE: threads > 0 adds mt if it is not set, the call is repeated without it if the handler
+        // rejects it; used is the mt value set, 0 if unknown
+        HRESULT Apply(IUnknown* handler, UInt32 threads, UInt32& used) const;
+
+    private:
+
+        CObjectVector<UString> names;
+        CObjectVector<NWindows::NCOM::CPropVariant> values;
+    };
+
+    class CInStream;
+
+    struct CReadAheadBlock {
+        CByteBuffer data;
+        UInt32 size = 0;
+        HRESULT result = S_OK;
+    };
+
+    // NOTE: the blocks following the last sequential read are loaded by the background thread,
+    // a read out of the loaded window is a miss, it is read directly and the thread is stopped
+    // until the reads are sequential again
+    class CReadAhead {
+
+    public:
+
+        CReadAhead(CInStream* instream, UInt32 numBlocks, UInt32 blockSize, CStreamStats* stats);
+        ~CReadAhead();
+
+        HRESULT Read(UInt64 position, void* data, UInt32 size, UInt32& processed);
+        void Reset();
+
+    private:
+
+        void run();
+        void restart(UInt64 position);
+
+        CInStream* instream;
+        CStreamStats* stats;
+        UInt32 blockSize;
+        CObjectVector<CReadAheadBlock> blocks;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::thread thread;
+
+        UInt64 start = 0;
+        unsigned head = 0;
+        unsigned filled = 0;
+        unsigned generation = 0;
+        bool active = false;
+        bool loading = false;
+        bool eof = false;
+        bool stop = false;
+
+        UInt64 lastEnd = 0;
+        unsigned streak = 0;
+    };
+
     class CInStream Z7_final :
         public IInStream,
         public CMyUnknownImp {
@@ -44,7 +147,8 @@ namespace sevenzip {
         STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) throw() Z7_override Z7_final;
 
         // NOTE: istream is owned by caller unless cloned is true
-        CInStream(Istream* istream, bool cloned = false);
+        // NOTE: positions are relative to the base, used by embedded archives
+        CInStream(Istream* istream, bool cloned = false, UInt64 base = 0, CStreamStats* stats = nullptr);
         virtual ~CInStream();
 
         HRESULT Open(const wchar_t* filename);
@@ -56,10 +160,82 @@ namespace sevenzip {
         UInt32 GetAttr(const wchar_t* pathname);
         UInt32 GetTime(const wchar_t* pathname);
 
+        // NOTE: streams with ReadAt are read at the own position of this wrapper,
+        // the wrappers sharing one stream do not move its position
+        bool IsPositional();
+        HRESULT GetEnd(UInt64& end);
+        void Share(const CInStream& parent);
+
+        // NOTE: the read-ahead wrapper keeps its own position too, the stream is read
+        // by ReadRaw only, positional or seek and read under the lock
+        void SetReadAhead(UInt32 numBlocks, UInt32 blockSize);
+        HRESULT ReadRaw(UInt64 position, void* data, UInt32 size, UInt32& processed);
+
     private:
 
         Istream* istream;
         bool cloned;
+        UInt64 base;
+        CStreamStats* stats;
+
+        // NOTE: the position is known after the first seek, the end after the first seek from the end
+        int positional = -1;
+        UInt64 position = 0;
+        bool known = false;
+        UInt64 end = 0;
+        bool ended = false;
+
+        CReadAhead* readahead = nullptr;
+        std::mutex rawMutex;
+        UInt64 cursor = 0;
+
+        // NOTE: the access pattern hints follow the reads, disabled if Advise is not implemented
+        void advise(UInt64 position, UInt32 size);
+        bool advisable = true;
+        int pattern = ADVICE_NORMAL;
+        UInt64 lastEnd = 0;
+        unsigned streak = 0;
+        UInt64 willneedEnd = 0;
+        UInt64 dontneedStart = 0;
+    };
+
+    struct CWriteBehindBuffer {
+        CByteBuffer data;
+        UInt32 size = 0;
+    };
+
+    // NOTE: full buffers are written by the background thread, the writer waits when all
+    // buffers are queued; the first write error is kept and returned by Write and Flush,
+    // the thread is started with the first full buffer, smaller data is written by Flush
+    class CWriteBehind {
+
+    public:
+
+        CWriteBehind(Ostream* ostream, UInt32 numBuffers, UInt32 bufferSize, CStreamStats* stats);
+        ~CWriteBehind();
+
+        HRESULT Write(const void* data, UInt32 size);
+        HRESULT Flush();
+
+    private:
+
+        void run();
+        HRESULT writeBuffer(const CWriteBehindBuffer& buffer);
+
+        Ostream* ostream;
+        CStreamStats* stats;
+        UInt32 bufferSize;
+        CObjectVector<CWriteBehindBuffer> buffers;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::thread thread;
+
+        unsigned head = 0;
+        unsigned queued = 0;
+        bool writing = false;
+        bool stop = false;
+        HRESULT result = S_OK;
     };
 
     class COutStream Z7_final :
@@ -77,23 +253,76 @@ namespace sevenzip {
         STDMETHOD(SetSize)(UInt64 size) throw() Z7_override Z7_final;
 
         // NOTE: ostream is owned by caller
-        COutStream(Ostream* ostream);
+        COutStream(Ostream* ostream, CStreamStats* stats = nullptr);
         virtual ~COutStream();
 
         HRESULT Open(const wchar_t* filename);
         void Close();
 
+        HRESULT Reserve(UInt64 size);
         HRESULT Mkdir(const wchar_t* dirname);
         HRESULT SetMode(const wchar_t* pathname, UInt32 mode);
         HRESULT SetAttr(const wchar_t* pathname, UInt32 attr);
         HRESULT SetTime(const wchar_t* pathname, UInt32 time);
 
+        // NOTE: the other calls flush the written data first, Flush returns the write error
+        void SetWriteBehind(UInt32 numBuffers, UInt32 bufferSize);
+        HRESULT Flush();
+
     private:
 
         Ostream* ostream;
+        CStreamStats* stats;
+        CWriteBehind* writebehind = nullptr;
+
+        // NOTE: the position is known after the first seek, the end after the first seek from the end
+        UInt64 position = 0;
+        bool known = false;
+        UInt64 end = 0;
+        bool ended = false;
     };
 
 
+    // NOTE: the streams of the one-shot coder calls, the output returns E_OUTOFMEMORY when it is full
+    class CBufferInStream Z7_final :
+        public ISequentialInStream,
+        public CMyUnknownImp {
+
+        Z7_COM_UNKNOWN_IMP_1(ISequentialInStream)
+
+    public:
+
+        STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize) throw() Z7_override Z7_final;
+
+        CBufferInStream(const void* data, UInt32 size) : data((const Byte*)data), size(size) {}
+
+    private:
+
+        const Byte* data;
+        UInt32 size;
+        UInt32 position = 0;
+    };
+
+    class CBufferOutStream Z7_final :
+        public ISequentialOutStream,
+        public CMyUnknownImp {
+
+        Z7_COM_UNKNOWN_IMP_1(ISequentialOutStream)
+
+    public:
+
+        STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize) throw() Z7_override Z7_final;
+
+        CBufferOutStream(void* data, UInt32 size) : data((Byte*)data), size(size) {}
+        UInt32 GetPosition() const { return position; }
+
+    private:
+
+        Byte* data;
+        UInt32 size;
+        UInt32 position = 0;
+    };
+
     class COpenCallback Z7_final :
         public IArchiveOpenCallback,
         public IArchiveOpenVolumeCallback,
@@ -121,7 +350,8 @@ namespace sevenzip {
 
         STDMETHOD(CryptoGetTextPassword)(BSTR* password) throw() Z7_override Z7_final;
 
-        COpenCallback(Istream* istream, const wchar_t* pathname, const wchar_t* password);
+        COpenCallback(Istream* istream, const wchar_t* pathname, const wchar_t* password,
+                CStreamStats* stats = nullptr);
         virtual ~COpenCallback();
         const wchar_t *Password() const;
 
@@ -133,9 +363,12 @@ namespace sevenzip {
         bool passworddefined;
         UString subarchivename;
         bool subarchivemode;
+        CStreamStats* stats;
     };
 
 
+    class CItemTable;
+
     class CExtractCallback Z7_final :
         public IArchiveExtractCallback,
         public ICryptoGetTextPassword,
@@ -156,18 +389,103 @@ namespace sevenzip {
 
         STDMETHOD(CryptoGetTextPassword) (BSTR* password) throw() Z7_override Z7_final;
 
-        CExtractCallback(Ostream* ostream, IInArchive* archive, const wchar_t* password);
+        CExtractCallback(Ostream* ostream, IInArchive* archive, const wchar_t* password,
+                CStreamStats* stats = nullptr);
+        // NOTE: a separate stream is created for every item, items table is owned by caller
+        CExtractCallback(OstreamFactory* factory, const CItemTable* items, IInArchive* archive, const wchar_t* password,
+                CStreamStats* stats = nullptr);
         virtual ~CExtractCallback();
 
+        void SetWriteBehind(UInt32 numBuffers, UInt32 bufferSize);
+        // NOTE: the indices of the extracted items are recorded instead of setting their metadata,
+        // the item paths are taken from the items table, both are owned by caller
+        void SetDeferredMetadata(const CItemTable* items, CRecordVector<UInt32>* metadata);
+
     private:
 
+        HRESULT GetFactoryStream(UInt32 index, ISequentialOutStream** outStream);
+        HRESULT SetFactoryResult(HRESULT result);
+
         CMyComPtr<ISequentialOutStream> outstream;
         IInArchive* archive;
         UString password;
         bool passworddefined;
         int index;
+
+        OstreamFactory* factory;
+        const CItemTable* items;
+        Ostream* itemstream;
+        CStreamStats* stats;
+        UInt32 writeBehindBuffers = 0;
+        UInt32 writeBehindBufferSize = 0;
+        CRecordVector<UInt32>* metadata = nullptr;
+    };
+
+
+    // NOTE: the item stream provided by the handler, seekable if it is an IInStream
+    class CItemIstream : public Istream {
+
+    public:
+
+        CItemIstream(ISequentialInStream* stream, UInt64 size);
+        virtual ~CItemIstream();
+
+        virtual HRESULT Read(void* data, UInt32 size, UInt32& processed) override;
+        virtual HRESULT Seek(Int64 offset, UInt32 origin, UInt64& position) override;
+        virtual UInt64 GetSize(const wchar_t* filename) override;
+
+    private:
+
+        CMyComPtr<ISequentialInStream> stream;
+        CMyComPtr<IInStream> seekable;
+        UInt64 size;
     };
 
+    // NOTE: the item is decoded by the background thread into the ring buffer, the decoder waits
+    // when the buffer is full and the reader when it is empty; deleting the stream aborts the decoder
+    class CPipeIstream : public Istream {
+
+    public:
+
+        CPipeIstream(UInt64 size, UInt32 bufferSize);
+        virtual ~CPipeIstream();
+
+        HRESULT Start(IInArchive* archive, UInt32 index, const wchar_t* password, CStreamStats* stats);
+
+        virtual HRESULT Read(void* data, UInt32 size, UInt32& processed) override;
+        virtual UInt64 GetSize(const wchar_t* filename) override;
+
+    private:
+
+        struct CWriter : public Ostream {
+            CPipeIstream* pipe = nullptr;
+            virtual HRESULT Open(const wchar_t* filename) override;
+            virtual HRESULT Write(const void* data, UInt32 size, UInt32& processed) override;
+        };
+
+        void run();
+        HRESULT write(const void* data, UInt32 size, UInt32& processed);
+
+        CMyComPtr<IInArchive> archive;
+        UInt32 index = 0;
+        UString password;
+        bool passworddefined = false;
+        CStreamStats* stats = nullptr;
+        CWriter writer;
+
+        CByteBuffer buffer;
+        size_t head = 0;
+        size_t used = 0;
+        UInt64 size;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::thread thread;
+
+        bool done = false;
+        bool cancelled = false;
+        HRESULT result = S_OK;
+    };
 
     class CUpdateCallback Z7_final :
         public IArchiveUpdateCallback2,
@@ -195,7 +513,7 @@ namespace sevenzip {
 
         STDMETHOD(CryptoGetTextPassword2)(Int32* passwordIsDefined, BSTR* password) throw() Z7_override Z7_final;
 
-        CUpdateCallback(Istream* istream, const wchar_t* password);
+        CUpdateCallback(Istream* istream, const wchar_t* password, CStreamStats* stats = nullptr);
         virtual ~CUpdateCallback();
 
         CObjectVector<UString> items;
@@ -208,6 +526,18 @@ namespace sevenzip {
     };
 
 
+    // NOTE: immutable format description, cached by Lib::Impl::load
+    struct CFormatInfo {
+        UString name;
+        UString extensions;
+        UStringVector exts;
+        GUID guid;
+        bool updatable;
+        UInt32 signatureOffset;
+        CObjectVector<CByteBuffer> signatures;
+    };
+
+
     class Lib::Impl {
 
     public:
@@ -223,6 +553,8 @@ namespace sevenzip {
 
         int getNumberOfMethods();
         wchar_t* getMethodName(int index);
+        UInt64 getMethodId(int index);
+        int getMethodByName(const wchar_t* name);
         // bool getMethodIsEncoder(int index);
 
         int getNumberOfFormats();
@@ -232,12 +564,17 @@ namespace sevenzip {
         int getFormatByExtension(const wchar_t* ext);
         int getFormatBySignature(Istream* stream, const wchar_t* ext);
         int getFormatBySignature(IInStream* stream, const wchar_t* ext);
+        int getFormatsBySignature(Istream* stream, int* formats, int maxFormats, const wchar_t* ext);
+        int findEmbeddedArchives(Istream* stream, EmbeddedArchive* archives, int maxArchives, UInt64 maxScanBytes);
 
         // for internal use
-        GUID getFormatGUID(int index);
+        GUID getFormatGUID(int index) const;
         UString getStringProperty(int propIndex, PROPID propID);
-        bool isExtensionSupported(int index, const wchar_t* ext);
+        bool isExtensionSupported(int index, const wchar_t* ext) const;
+        bool matchSignatures(IInStream* stream, const wchar_t* ext,
+                CRecordVector<int>& candidates, CRecordVector<UInt32>& lengths);
         bool checkInterfaceType() const;
+        bool getMethodCoder(int index, bool encoder, GUID& clsid);
 
         Func_CreateObject CreateObjectFunc = nullptr;
         Func_GetNumberOfMethods GetNumberOfMethods = nullptr;
@@ -254,6 +591,39 @@ namespace sevenzip {
 
         void _unload();
 
+        void buildRegistry();
+        void clearRegistry();
+
+        // NOTE: extensions hash, chains keep entries in the format order
+        struct CExtensionEntry {
+            UInt32 hash;
+            int formatIndex;
+            unsigned extIndex;
+            int next;
+        };
+
+        CObjectVector<CFormatInfo> formats;
+        CRecordVector<CExtensionEntry> extensions;
+        CRecordVector<int> extensionBuckets;
+
+        // NOTE: signatures grouped by offset and dispatched by the first byte
+        struct CSignatureEntry {
+            int formatIndex;
+            unsigned signatureIndex;
+            int next;
+        };
+
+        struct CSignatureGroup {
+            UInt32 offset;
+            bool tail;
+            int buckets[256];
+        };
+
+        CObjectVector<CSignatureGroup> signatureGroups;
+        CRecordVector<CSignatureEntry> signatureEntries;
+        UInt32 signatureHeadSize = 0;
+        UInt32 signatureTailSize = 0;
+
         wchar_t loadMessage[128] = { L'\0' };
         wchar_t lastMethodName[128] = { L'\0' };
         wchar_t lastFormatName[128] = { L'\0' };
@@ -261,6 +631,59 @@ namespace sevenzip {
     };
 
 
+    // NOTE: structure of arrays, paths are stored zero terminated in one buffer
+    class CItemTable {
+
+    public:
+
+        void Clear();
+        unsigned Size() const { return sizes.Size(); }
+        void Get(unsigned index, ItemInfo& info) const;
+
+        CRecordVector<UInt32> pathOffsets;
+        CRecordVector<wchar_t> paths;
+        CRecordVector<UInt64> sizes;
+        CRecordVector<UInt64> packSizes;
+        CRecordVector<UInt32> times;
+        CRecordVector<UInt32> attrs;
+        CRecordVector<UInt32> modes;
+        CRecordVector<UInt32> crcs;
+        CRecordVector<UInt32> blocks;
+        CRecordVector<Byte> flags;
+
+        enum { kIsDir = 1, kHasCrc = 2, kHasBlock = 4 };
+    };
+
+
+    // NOTE: an extracted item with the deferred metadata, stream is the index of the output stream
+    struct CMetadataItem {
+        UInt32 index;
+        UInt32 depth;
+        UInt32 stream;
+    };
+
+
+    // NOTE: items are grouped by block in the index order,
+    // item ends are the block decoded sizes up to and including the item
+    class CBlockTable {
+
+    public:
+
+        void Clear();
+        unsigned Size() const { return ids.Size(); }
+        void Get(unsigned index, BlockInfo& info) const;
+
+        CRecordVector<UInt32> ids;
+        CRecordVector<UInt64> packSizes;
+        CRecordVector<UInt32> methodOffsets;
+        CRecordVector<wchar_t> methods;
+        CRecordVector<UInt32> itemOffsets;
+        CRecordVector<UInt32> items;
+        CRecordVector<UInt64> itemEnds;
+        CRecordVector<int> itemBlocks;
+    };
+
+
     class Iarchive::Impl {
 
     public:
@@ -269,11 +692,29 @@ namespace sevenzip {
         ~Impl();
 
         HRESULT open(Lib::Impl* libimpl, Istream* istream,
-                const wchar_t* filename, const wchar_t* password, int formatIndex);
+                const wchar_t* filename, const wchar_t* password, int formatIndex, UInt64 offset = 0,
+                const CInStream* shared = nullptr);
 
         void close();
 
+        void setReadAhead(UInt32 numBlocks, UInt32 blockSize);
+        void setWriteBehind(UInt32 numBuffers, UInt32 bufferSize);
+        void setDeferredMetadata(int numThreads);
+        void setSkipUnchanged(int mode, int numThreads);
+
+        HRESULT setStringProperty(const wchar_t* name, const wchar_t* value);
+        HRESULT setBoolProperty(const wchar_t* name, bool value);
+        HRESULT setIntProperty(const wchar_t* name, UInt32 value);
+        HRESULT setWideProperty(const wchar_t* name, UInt64 value);
+        HRESULT setEmptyProperty(const wchar_t* name);
+
         HRESULT extract(Ostream* ostream, const wchar_t* password, int index);
+        HRESULT extract(Ostream* ostream, const wchar_t* password, const UInt32* indices, UInt32 count);
+        HRESULT extract(Ostream* ostream, const wchar_t* password, Iselector* selector);
+        HRESULT extract(Ostream* const* ostreams, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count);
+        HRESULT extract(OstreamFactory* factory, int numThreads, const wchar_t* password, const UInt32* indices, UInt32 count);
+
+        HRESULT openItem(int index, const wchar_t* password, Istream*& istream, UInt32 bufferSize);
 
         int getNumberOfItems();
         wchar_t* getItemPath(int index);
@@ -283,6 +724,19 @@ namespace sevenzip {
         UInt32 getItemTime(int index);
         bool getItemIsDir(int index);
 
+        HRESULT snapshot();
+        HRESULT getItemInfo(int index, ItemInfo& info);
+
+        int getNumberOfBlocks();
+        HRESULT getBlockInfo(int blockIndex, BlockInfo& info);
+        HRESULT planExtract(const UInt32* indices, UInt32 count, ExtractPlan& plan,
+                BlockPlan* blocks, UInt32 maxBlocks);
+        HRESULT findChanged(Ostream* ostream, const UInt32* indices, UInt32 count,
+                UInt32* changed, UInt32& numChanged);
+
+        void getStats(Stats& stats);
+        void resetStats();
+
         int getNumberOfProperties();
         HRESULT getPropertyInfo(int propIndex, PROPID& propId, VARTYPE& propType);
         HRESULT getStringProperty(PROPID propId, const wchar_t*& propValue);
@@ -301,12 +755,54 @@ namespace sevenzip {
 
     private:
 
+        HRESULT extractItems(Ostream* ostream, const wchar_t* password, CRecordVector<UInt32>& items);
+        HRESULT extractStored(Ostream* ostream, CRecordVector<UInt32>& items, CRecordVector<UInt32>* metadata);
+        HRESULT getStoredRange(UInt32 index, UInt64 size, int format, UInt64& start);
+        HRESULT extractSorted(Ostream* ostream, OstreamFactory* factory, const CItemTable* table,
+                const wchar_t* password, CRecordVector<UInt32>& items, CRecordVector<UInt32>* metadata = nullptr);
+        HRESULT extractParallel(Ostream* const* ostreams, OstreamFactory* factory, int numThreads,
+                const wchar_t* password, const UInt32* indices, UInt32 count,
+                CObjectVector<CRecordVector<UInt32>>* metadata = nullptr);
+        HRESULT extractCloned(Istream* clone, const CInStream* shared, Ostream* ostream, OstreamFactory* factory,
+                const wchar_t* password, CRecordVector<UInt32>& items, CRecordVector<UInt32>* metadata);
+        void applyMetadata(Ostream* const* ostreams, const CObjectVector<CRecordVector<UInt32>>& metadata);
+        HRESULT skipUnchanged(Ostream* ostream, CRecordVector<UInt32>& items);
+        HRESULT setProperties(IInArchive* archive, bool outer);
+        bool isParallelizable();
+        HRESULT buildBlockMap();
+        void planUnits(const CRecordVector<UInt32>& items,
+                CRecordVector<UInt32>& itemUnits, CRecordVector<BlockPlan>& units);
+
+        // NOTE: open arguments are kept to reopen the archive by the parallel workers
+        Lib::Impl* libimpl = nullptr;
+        Istream* istream = nullptr;
+        UString filename;
+        UInt64 offset = 0;
+
         CMyComPtr<IInStream> instream;
         CMyComPtr<IInArchive> inarchive;
         CMyComPtr<IArchiveOpenCallback> opencallback;
         CObjectVector<CMyComPtr<IInArchive>> inarchives;
         int formatIndex = -1;
 
+        CItemTable items;
+        bool snapshotted = false;
+
+        CBlockTable blocks;
+        bool blockmapped = false;
+
+        CStreamStats stats;
+        UInt32 readAheadBlocks = 0;
+        UInt32 readAheadBlockSize = 0;
+        UInt32 writeBehindBuffers = 0;
+        UInt32 writeBehindBufferSize = 0;
+        int metadataThreads = 0;
+        int skipMode = SKIP_NONE;
+        int skipThreads = 0;
+
+        // NOTE: decoder properties, set on every handler created by open, the workers included
+        CHandlerProperties properties;
+
         wchar_t lastItemPath[1024] = { L'\0' };
         wchar_t lastStringProperty[1024] = { L'\0' };
     };
@@ -328,6 +824,9 @@ namespace sevenzip {
 
         HRESULT update();
 
+        void getStats(Stats& stats);
+        void resetStats();
+
         HRESULT setStringProperty(const wchar_t* name, const wchar_t* value);
         HRESULT setBoolProperty(const wchar_t* name, bool value);
         HRESULT setIntProperty(const wchar_t* name, UInt32 value);
@@ -340,6 +839,470 @@ namespace sevenzip {
         CMyComPtr<IOutArchive> outarchive;
         CMyComPtr<IArchiveUpdateCallback2> updatecallback;
         int formatIndex = -1;
+
+        // NOTE: encoder properties, set again by one call before the update
+        CHandlerProperties properties;
+
+        CStreamStats stats;
+    };
+
+    struct CCodecKey {
+        UString method;
+        UInt32 level = (UInt32)(Int32)-1;
+        UInt32 dictionarySize = 0;
+        UInt32 numThreads = 0;
+
+        bool Matches(const wchar_t* method, UInt32 level, UInt32 dictionarySize, UInt32 numThreads) const {
+            return this->level == level && this->dictionarySize == dictionarySize
+                && this->numThreads == numThreads && wcscmp(this->method, method) == 0;
+        }
+    };
+
+    class Codec::Impl {
+
+    public:
+
+        Impl();
+        ~Impl();
+
+        HRESULT open(Lib::Impl* libimpl, const wchar_t* method);
+        void close();
+
+        HRESULT setLevel(UInt32 level);
+        HRESULT setDictionarySize(UInt32 dictionarySize);
+        HRESULT setNumberOfThreads(UInt32 numThreads);
+
+        HRESULT getEncoderProperties(void* data, UInt32 size, UInt32& processed);
+        HRESULT setDecoderProperties(const void* data, UInt32 size);
+
+        HRESULT encode(Istream* istream, Ostream* ostream, UInt64 inSize);
+        HRESULT decode(Istream* istream, Ostream* ostream, UInt64 outSize);
+        HRESULT encode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed);
+        HRESULT decode(const void* in, UInt32 inSize, void* out, UInt32 outSize, UInt32& processed);
+
+        // for internal use
+        HRESULT encode(ISequentialInStream* instream, ISequentialOutStream* outstream, const UInt64* inSize);
+        HRESULT decode(ISequentialInStream* instream, ISequentialOutStream* outstream, const UInt64* outSize);
+        bool getKey(const Lib::Impl* libimpl, CCodecKey& key) const;
+        void reset();
+
+    private:
+
+        HRESULT prepareEncoder();
+        HRESULT prepareDecoder();
+        UInt32 getThreads() const;
+
+        Lib::Impl* libimpl = nullptr;
+        UString method;
+        int methodIndex = -1;
+        GUID encoderGuid;
+        GUID decoderGuid;
+        bool hasEncoder = false;
+        bool hasDecoder = false;
+
+        CMyComPtr<ICompressCoder> encoder;
+        CMyComPtr<ICompressCoder> decoder;
+
+        // NOTE: the encoder properties are set again when changed, level is -1 and dictionarySize 0 when not set
+        UInt32 level = (UInt32)(Int32)-1;
+        UInt32 dictionarySize = 0;
+        UInt32 numThreads = 0;
+        bool changed = true;
+        CByteBuffer encoderProps;
+        UInt32 encoderPropsSize = 0;
+        CByteBuffer decoderProps;
+        bool hasDecoderProps = false;
+    };
+
+    // NOTE: the idle codecs are grouped by the method name as given and the encoder properties,
+    // a hit does not call the library
+    class CodecPool::Impl {
+
+    public:
+
+        Impl();
+        ~Impl();
+
+        HRESULT open(Lib::Impl* libimpl, UInt32 maxIdle);
+        void close();
+
+        HRESULT acquire(const wchar_t* method, Codec*& codec,
+                UInt32 level, UInt32 dictionarySize, UInt32 numThreads);
+        void release(Codec* codec);
+
+        void getStats(PoolStats& stats);
+        void resetStats();
+
+    private:
+
+        struct CEntry {
+            CCodecKey key;
+            CRecordVector<Codec*> idle;
+        };
+
+        std::mutex mutex;
+        Lib::Impl* libimpl = nullptr;
+        UInt32 maxIdle = 0;
+        CObjectVector<CEntry> entries;
+        UInt64 hits = 0;
+        UInt64 misses = 0;
+    };
+
+    // NOTE: the file descriptor is shared by the cloned streams
+    class CFileHandle {
+
+    public:
+
+        static HRESULT Open(const UString& path, bool write, CFileHandle*& file);
+#ifndef _WIN32
+        // NOTE: the output file name is relative to the directory descriptor, path is kept for the lookups
+        static HRESULT OpenAt(int dirfd, const UString& name, const UString& path, CFileHandle*& file);
+#endif
+        void AddRef();
+        void Release();
+
+        HRESULT ReadAt(UInt64 offset, void* data, UInt32 size, UInt32& processed);
+        HRESULT WriteAt(UInt64 offset, const void* data, UInt32 size, UInt32& processed);
+        HRESULT GetSize(UInt64& size);
+        HRESULT SetSize(UInt64 size);
+        HRESULT Reserve(UInt64 size);
+        HRESULT SetMode(UInt32 mode);
+        HRESULT SetTime(UInt32 time);
+        // NOTE: the range of the source file is copied by the kernel, E_NOTIMPL if it cannot be
+        HRESULT CopyFrom(CFileHandle* source, UInt64 offset, UInt64 position, UInt64 size, UInt64& processed);
+
+        // NOTE: the mapping lives with the handle, S_FALSE if the file is empty or too large
+        HRESULT Map();
+        HRESULT Advise(UInt64 offset, UInt64 size, int advice);
+
+#ifdef _WIN32
+        HANDLE handle;
+        HANDLE mapping = NULL;
+#else
+        int fd;
+#endif
+        UString path;
+        const Byte* view = nullptr;
+        UInt64 viewSize = 0;
+
+    private:
+
+        CFileHandle();
+        ~CFileHandle();
+
+        std::atomic<unsigned> refs;
+    };
+
+    struct CFileStat {
+        UInt64 size;
+        UInt32 mode;
+        UInt32 attr;
+        UInt32 time;
+        bool isDir;
+    };
+
+    // NOTE: one stat per pathname, the opened file is checked by the descriptor
+    class CFileStatCache {
+
+    public:
+
+        const CFileStat* Get(const wchar_t* pathname, CFileHandle* file);
+
+    private:
+
+        UString path;
+        CFileStat stat;
+        bool valid = false;
+    };
+
+
+    // NOTE: the file of the built-in input streams, nullptr for other streams or when not opened
+    struct CFileSource {
+        static CFileHandle* Get(Istream& istream);
+    };
+
+    class FileIstream::Impl {
+
+    public:
+
+        Impl(UInt32 blockSize);
+        ~Impl();
+
+        HRESULT open(const wchar_t* filename);
+        void close();
+        HRESULT read(void* data, UInt32 size, UInt32& processed);
+        HRESULT readAt(UInt64 offset, void* data, UInt32 size, UInt32& processed);
+        HRESULT seek(Int64 offset, UInt32 origin, UInt64& position);
+        HRESULT advise(UInt64 offset, UInt64 size, int advice);
+        const CFileStat* getStat(const wchar_t* pathname);
+        void share(const Impl* impl);
+        CFileHandle* getFile() const;
+
+        UInt32 blockSize;
+
+    private:
+
+        CFileHandle* file = nullptr;
+        UInt64 position = 0;
+        CByteBuffer buffer;
+        UInt64 bufferPos = 0;
+        UInt32 bufferLen = 0;
+
+        CFileStatCache stats;
+    };
+
+
+    class MmapIstream::Impl {
+
+    public:
+
+        Impl();
+        ~Impl();
+
+        HRESULT open(const wchar_t* filename);
+        void close();
+        HRESULT read(void* data, UInt32 size, UInt32& processed);
+        HRESULT readAt(UInt64 offset, void* data, UInt32 size, UInt32& processed);
+        HRESULT seek(Int64 offset, UInt32 origin, UInt64& position);
+        HRESULT advise(UInt64 offset, UInt64 size, int advice);
+        const CFileStat* getStat(const wchar_t* pathname);
+        void share(const Impl* impl);
+        bool isMapped() const;
+        CFileHandle* getFile() const;
+
+    private:
+
+        CFileHandle* file = nullptr;
+        UInt64 position = 0;
+
+        CFileStatCache stats;
+    };
+
+
+    class FileOstream::Impl {
+
+    public:
+
+        Impl(const wchar_t* basepath);
+        ~Impl();
+
+        HRESULT open(const wchar_t* filename);
+        void close();
+        HRESULT write(const void* data, UInt32 size, UInt32& processed);
+        HRESULT seek(Int64 offset, UInt32 origin, UInt64& position);
+        HRESULT setSize(UInt64 size);
+        HRESULT reserve(UInt64 size);
+        HRESULT mkdir(const wchar_t* dirname);
+        HRESULT setMode(const wchar_t* path, UInt32 mode);
+        HRESULT setAttr(const wchar_t* path, UInt32 attr);
+        HRESULT setTime(const wchar_t* path, UInt32 time);
+        HRESULT stat(const wchar_t* path, UInt64& size, UInt32& time);
+        HRESULT getCrc(const wchar_t* path, UInt32& crc);
+        HRESULT writeFrom(CFileHandle* source, UInt64 offset, UInt64 size, UInt64& processed);
+
+    private:
+
+        UString getFullPath(const wchar_t* path) const;
+
+        CFileHandle* file = nullptr;
+        UInt64 position = 0;
+        UString basepath;
+    };
+
+    // NOTE: the directories are looked up relative to the cached handles of their parents and created
+    // once, all handles are closed when the cache is full; pathnames are relative to the root directory,
+    // the calls are serialized
+    class CDirectoryCache {
+
+    public:
+
+        CDirectoryCache(const wchar_t* root);
+        ~CDirectoryCache();
+
+        HRESULT OpenFile(const UString& path, CFileHandle*& file);
+        HRESULT MakeDirectory(const UString& path);
+        HRESULT SetMode(const UString& path, UInt32 mode);
+        HRESULT SetAttr(const UString& path, UInt32 attr);
+        HRESULT SetTime(const UString& path, UInt32 time);
+        HRESULT Stat(const UString& path, UInt64& size, UInt32& time);
+        HRESULT GetCrc(const UString& path, UInt32& crc);
+
+    private:
+
+        UString getFullPath(const UString& path) const;
+#ifndef _WIN32
+        HRESULT getRoot(int& dirfd);
+        HRESULT getDirectory(const UString& path, int& dirfd);
+        HRESULT getParent(const UString& path, int& dirfd, UString& name);
+        void trim();
+#endif
+
+        UString root;
+        std::mutex mutex;
+        std::unordered_set<std::wstring> created;
+#ifndef _WIN32
+        int rootfd = -1;
+        std::unordered_map<std::wstring, int> handles;
+#endif
+    };
+
+
+    class DirectoryOstream::Impl {
+
+    public:
+
+        Impl(const wchar_t* basepath);
+        ~Impl();
+
+        HRESULT open(const wchar_t* filename);
+        void close();
+        HRESULT write(const void* data, UInt32 size, UInt32& processed);
+        HRESULT seek(Int64 offset, UInt32 origin, UInt64& position);
+        HRESULT setSize(UInt64 size);
+        HRESULT reserve(UInt64 size);
+        HRESULT mkdir(const wchar_t* dirname);
+        HRESULT setMode(const wchar_t* path, UInt32 mode);
+        HRESULT setAttr(const wchar_t* path, UInt32 attr);
+        HRESULT setTime(const wchar_t* path, UInt32 time);
+        HRESULT stat(const wchar_t* path, UInt64& size, UInt32& time);
+        HRESULT getCrc(const wchar_t* path, UInt32& crc);
+        HRESULT writeFrom(CFileHandle* source, UInt64 offset, UInt64 size, UInt64& processed);
+
+    private:
+
+        CFileHandle* file = nullptr;
+        UInt64 position = 0;
+        CDirectoryCache dirs;
+    };
+
+    // NOTE: data is kept in memory up to the item size limit, the file of a larger item
+    // is opened by the writer and passed to the pool with its metadata
+    struct CBatchItem {
+        UString path;
+        CByteBuffer data;
+        size_t size = 0;
+        CFileHandle* file = nullptr;
+        UInt64 position = 0;
+        UInt32 mode = 0;
+        UInt32 attr = 0;
+        UInt32 time = 0;
+        bool hasMode = false;
+        bool hasAttr = false;
+        bool hasTime = false;
+        bool closed = false;
+    };
+
+    // NOTE: io_uring without liburing, an item is written by a linked chain of openat into a
+    // registered file slot, write through the slot and close of the slot; the completions are
+    // tagged with the slot and the operation, the ring is used by one thread
+    class CBatchUring {
+
+    public:
+
+        static CBatchUring* Create(unsigned slots);
+        ~CBatchUring();
+
+        unsigned Slots() const { return slots; };
+        void Queue(unsigned slot, const char* path, const void* data, UInt32 size, UInt32 mode);
+        HRESULT Submit();
+        HRESULT Wait();
+        bool Unqueue(unsigned& slot, unsigned& op);
+        bool Reap(unsigned& slot, unsigned& op, int& res);
+        void Release(unsigned slot);
+
+    private:
+
+        CBatchUring(int fd, unsigned slots) : fd(fd), slots(slots) {};
+        CBatchUring(const CBatchUring&) = delete;
+        CBatchUring& operator=(const CBatchUring&) = delete;
+
+        bool init(const io_uring_params& params);
+        io_uring_sqe* getSqe();
+
+        int fd;
+        unsigned slots;
+        void* ring = nullptr;
+        size_t ringSize = 0;
+        void* sqes = nullptr;
+        size_t sqesSize = 0;
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqLocal = 0;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        void* cqes = nullptr;
+        unsigned cqMask = 0;
+    };
+
+    struct CBatchSlot {
+        CBatchItem* item = nullptr;
+        AString path;
+        unsigned pending = 0;
+        int opened = 0;
+        int written = 0;
+        int closed = 0;
+    };
+
+    // NOTE: the current item is queued by the next Open, Mkdir or Flush, so the metadata set
+    // after Close goes with it; the writer waits when the queue is full, the threads are started
+    // with the first queued item, the first error is kept with its path and returned by Flush only;
+    // the metadata setters can be called concurrently once the items are closed; with io_uring the
+    // threads are replaced by one thread submitting the chains of the items
+    class BatchFileOstream::Impl {
+
+    public:
+
+        Impl(const wchar_t* basepath, int numThreads, UInt32 queueDepth, UInt32 itemSizeMax, bool ioUring);
+        ~Impl();
+
+        HRESULT open(const wchar_t* filename);
+        void close();
+        HRESULT write(const void* data, UInt32 size, UInt32& processed);
+        HRESULT reserve(UInt64 size);
+        HRESULT mkdir(const wchar_t* dirname);
+        HRESULT setMode(const wchar_t* path, UInt32 mode);
+        HRESULT setAttr(const wchar_t* path, UInt32 attr);
+        HRESULT setTime(const wchar_t* path, UInt32 time);
+        HRESULT stat(const wchar_t* path, UInt64& size, UInt32& time);
+        HRESULT getCrc(const wchar_t* path, UInt32& crc);
+        HRESULT flush();
+        const wchar_t* getErrorPath() const;
+        bool isUring() const;
+
+    private:
+
+        void run();
+        void runUring();
+        HRESULT finishSlot(CBatchSlot& slot, unsigned index);
+        void releaseItem(CBatchItem* item, HRESULT hr, bool reuse = true);
+        void submit();
+        HRESULT openDirect(CBatchItem* item);
+        HRESULT writeItem(CBatchItem* item);
+        CBatchItem* getItem(const UString& path, std::unique_lock<std::mutex>& lock);
+        UString getFullPath(const wchar_t* path) const;
+
+        UString basepath;
+        unsigned numThreads;
+        UInt32 itemSizeMax;
+        CBatchUring* uring = nullptr;
+        UInt32 umaskBits = 07777;
+        CBatchItem* current = nullptr;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::thread> threads;
+
+        CRecordVector<CBatchItem*> queue;
+        CRecordVector<CBatchItem*> spare;
+        CRecordVector<CBatchItem*> running;
+        unsigned head = 0;
+        unsigned queued = 0;
+        bool stop = false;
+        HRESULT result = S_OK;
+        UString resultPath;
+        UString errorPath;
     };
 
 #define COPYACHARS(_d_,_s_) (wcsncpy((_d_),(as2us(_s_)),(sizeof(_d_)/sizeof(_d_[0])-1)))
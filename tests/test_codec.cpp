@@ -0,0 +1,93 @@
+#include <iostream>
+#include "sevenzip.h"
+
+static void CHECK(bool cond, const char* msg) {
+    if (!cond) {
+        std::cerr << "FAIL: " << msg << std::endl;
+        throw std::runtime_error(msg);
+    }
+}
+
+// A minimal fake Istream implementation
+struct FakeIstream : public sevenzip::Istream {
+    virtual HRESULT Open(const wchar_t* /*filename*/) override {
+        return S_OK;
+    }
+    virtual HRESULT Read(void* /*data*/, UInt32 /*size*/, UInt32& processed) override {
+        processed = 0;
+        return S_OK;
+    }
+    virtual void Close() override {}
+    virtual HRESULT Seek(Int64 /*offset*/, UInt32 /*origin*/, UInt64& /*position*/) override {
+        return S_OK;
+    }
+};
+
+// Minimal fake Ostream
+struct FakeOstream : public sevenzip::Ostream {
+    virtual HRESULT Open(const wchar_t* /*filename*/) override {
+        return S_OK;
+    }
+    virtual HRESULT Write(const void* /*data*/, UInt32 size, UInt32& processed) override {
+        processed = size;
+        return S_OK;
+    }
+    virtual void Close() override {}
+};
+
+void run_codec_tests() {
+    std::cout << "Running codec tests... ";
+
+    sevenzip::Lib l; // not loaded
+    FakeIstream in;
+    FakeOstream out;
+
+    // Lib: no methods without the library
+    CHECK(l.getMethodByName(L"LZMA2") == -1, "Lib::getMethodByName should return -1 when library not loaded");
+    CHECK(l.getMethodId(0) == 0, "Lib::getMethodId should return 0 when library not loaded");
+
+    // Codec: open without the library -> S_FALSE
+    sevenzip::Codec codec;
+    CHECK(codec.open(l, L"LZMA2") == S_FALSE, "Codec::open should return S_FALSE when library CreateObjectFunc is not available");
+    CHECK(codec.open(l, nullptr) == S_FALSE, "Codec::open should return S_FALSE without a method");
+
+    // Codec: properties and coding of unopened codec -> S_FALSE
+    CHECK(codec.setLevel(5) == S_FALSE, "Codec::setLevel should return S_FALSE when codec is not opened");
+    CHECK(codec.setDictionarySize(1 << 20) == S_FALSE, "Codec::setDictionarySize should return S_FALSE when codec is not opened");
+    CHECK(codec.setNumberOfThreads(2) == S_FALSE, "Codec::setNumberOfThreads should return S_FALSE when codec is not opened");
+    const unsigned char props[5] = {0x5d, 0, 0, 0x10, 0};
+    CHECK(codec.setDecoderProperties(props, 5) == S_FALSE, "Codec::setDecoderProperties should return S_FALSE when codec is not opened");
+    unsigned char buffer[16];
+    UInt32 processed = 1;
+    CHECK(codec.getEncoderProperties(buffer, sizeof(buffer), processed) == S_FALSE && processed == 0,
+        "Codec::getEncoderProperties should return S_FALSE when codec is not opened");
+
+    CHECK(codec.encode(in, out) == S_FALSE, "Codec::encode should return S_FALSE when codec is not opened");
+    CHECK(codec.decode(in, out, 16) == S_FALSE, "Codec::decode should return S_FALSE when codec is not opened");
+    const char data[] = "0123456789";
+    processed = 1;
+    CHECK(codec.encode(data, 10, buffer, sizeof(buffer), processed) == S_FALSE && processed == 0,
+        "Codec::encode of a buffer should return S_FALSE when codec is not opened");
+    processed = 1;
+    CHECK(codec.decode(data, 10, buffer, sizeof(buffer), processed) == S_FALSE && processed == 0,
+        "Codec::decode of a buffer should return S_FALSE when codec is not opened");
+    codec.close();
+
+    // CodecPool: open without the library -> S_FALSE, acquire of unopened pool -> S_FALSE
+    sevenzip::CodecPool pool;
+    CHECK(pool.open(l) == S_FALSE, "CodecPool::open should return S_FALSE when library CreateObjectFunc is not available");
+    sevenzip::Codec* pooled = &codec;
+    CHECK(pool.acquire(L"LZMA", pooled, 5) == S_FALSE && pooled == nullptr,
+        "CodecPool::acquire should return S_FALSE when pool is not opened");
+    pool.release(nullptr);
+
+    // CodecPool: unopened codecs are not kept
+    pool.release(new sevenzip::Codec());
+    sevenzip::PoolStats stats;
+    pool.getStats(stats);
+    CHECK(stats.hits == 0 && stats.misses == 0 && stats.idle == 0, "CodecPool::getStats should be empty when pool is not opened");
+    pool.resetStats();
+    pool.close();
+
+    std::cout << "codec tests passed." << std::endl;
+}
@@ -0,0 +1,226 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include "sevenzip.h"
+
+static void CHECK(bool cond, const char* msg) {
+    if (!cond) {
+        std::cerr << "FAIL: " << msg << std::endl;
+        throw std::runtime_error(msg);
+    }
+}
+
+void run_file_tests() {
+    std::cout << "Running file tests... ";
+
+    HRESULT hr;
+    UInt32 processed;
+    UInt64 position;
+    const wchar_t* filename = L"test_file.tmp";
+    const char data[] = "0123456789abcdef";
+
+    // FileOstream: write, seek and overwrite
+    sevenzip::FileOstream out;
+    hr = out.Open(filename);
+    CHECK(hr == S_OK, "FileOstream::Open should create the file");
+    hr = out.Write(data, 16, processed);
+    CHECK(hr == S_OK && processed == 16, "FileOstream::Write should write all data");
+    hr = out.Seek(-6, SZ_SEEK_END, position);
+    CHECK(hr == S_OK && position == 10, "FileOstream::Seek from end should return position");
+    hr = out.Write("ABCDEF", 6, processed);
+    CHECK(hr == S_OK && processed == 6, "FileOstream::Write after seek should write all data");
+    out.Close();
+
+    // FileOstream: destination check of the skip-if-unchanged extraction
+    UInt64 statSize = 0;
+    UInt32 statTime = 0;
+    UInt32 crc = 0;
+    hr = out.Stat(filename, statSize, statTime);
+    CHECK(hr == S_OK && statSize == 16 && statTime != 0, "FileOstream::Stat should return the size and time");
+    hr = out.GetCrc(filename, crc);
+    CHECK(hr == S_OK && crc == 0x983C37B5, "FileOstream::GetCrc should return the CRC of the file");
+    hr = out.Stat(L"test_file.missing", statSize, statTime);
+    CHECK(hr == S_FALSE, "FileOstream::Stat should return S_FALSE on a missing file");
+
+    // FileIstream: small block buffer, buffered and direct reads
+    sevenzip::FileIstream in(4096);
+    hr = in.Open(filename);
+    CHECK(hr == S_OK, "FileIstream::Open should open the file");
+    CHECK(in.GetSize(filename) == 16, "FileIstream::GetSize should return file size");
+    CHECK(!in.IsDir(filename), "FileIstream::IsDir should return false for a file");
+    char buffer[8192] = {};
+    hr = in.Read(buffer, 4, processed);
+    CHECK(hr == S_OK && processed == 4 && memcmp(buffer, "0123", 4) == 0, "FileIstream::Read should read data");
+    hr = in.Read(buffer, sizeof(buffer), processed);
+    CHECK(hr == S_OK && processed == 12 && memcmp(buffer, "456789ABCDEF", 12) == 0, "FileIstream::Read should stop at the end");
+    hr = in.Read(buffer, 4, processed);
+    CHECK(hr == S_OK && processed == 0, "FileIstream::Read at the end should return no data");
+    hr = in.Seek(-4, SZ_SEEK_CUR, position);
+    CHECK(hr == S_OK && position == 12, "FileIstream::Seek from current should return position");
+    hr = in.Seek(-1, SZ_SEEK_SET, position);
+    CHECK(hr != S_OK, "FileIstream::Seek before the start should fail");
+
+    // FileIstream: positional read does not move the position
+    hr = in.ReadAt(10, buffer, 4, processed);
+    CHECK(hr == S_OK && processed == 4 && memcmp(buffer, "ABCD", 4) == 0, "FileIstream::ReadAt should read at the offset");
+    hr = in.ReadAt(14, buffer, 4, processed);
+    CHECK(hr == S_OK && processed == 2, "FileIstream::ReadAt should stop at the end");
+    hr = in.Read(buffer, 2, processed);
+    CHECK(hr == S_OK && processed == 2 && memcmp(buffer, "CD", 2) == 0, "FileIstream::Read after ReadAt should keep the position");
+
+    // FileOstream: range copy from the input file, not supported on every platform
+    sevenzip::FileOstream copy;
+    UInt64 copied = 0;
+    hr = copy.Open(L"test_copy.tmp");
+    CHECK(hr == S_OK, "FileOstream::Open should create the copy");
+    hr = copy.WriteFrom(in, 4, 8, copied);
+    CHECK(hr == E_NOTIMPL || (hr == S_OK && copied == 8), "FileOstream::WriteFrom should copy the range");
+    copy.Close();
+    if (hr == S_OK) {
+        sevenzip::FileIstream check;
+        hr = check.Open(L"test_copy.tmp");
+        CHECK(hr == S_OK && check.ReadAt(0, buffer, sizeof(buffer), processed) == S_OK && processed == 8
+                && memcmp(buffer, "456789AB", 8) == 0, "FileOstream::WriteFrom should write the range");
+    }
+    std::remove("test_copy.tmp");
+
+    // FileIstream: clone shares the file and keeps its own position
+    sevenzip::Istream* clone = in.Clone();
+    CHECK(clone != nullptr, "FileIstream::Clone should return a stream");
+    hr = clone->Open(filename);
+    CHECK(hr == S_OK, "FileIstream clone Open should reuse the file");
+    hr = clone->Read(buffer, 2, processed);
+    CHECK(hr == S_OK && processed == 2 && memcmp(buffer, "01", 2) == 0, "FileIstream clone should read from the start");
+    in.Close();
+    hr = clone->Read(buffer, 2, processed);
+    CHECK(hr == S_OK && processed == 2 && memcmp(buffer, "23", 2) == 0, "FileIstream clone should read after the origin is closed");
+    clone->Close();
+    delete clone;
+
+    // MmapIstream: reads from the mapping, clone shares it
+    sevenzip::MmapIstream mapped;
+    hr = mapped.Open(filename);
+    CHECK(hr == S_OK, "MmapIstream::Open should open the file");
+    CHECK(mapped.IsMapped(), "MmapIstream::IsMapped should be true for a small file");
+    CHECK(mapped.GetSize(filename) == 16, "MmapIstream::GetSize should return file size");
+    hr = mapped.Read(buffer, 6, processed);
+    CHECK(hr == S_OK && processed == 6 && memcmp(buffer, "012345", 6) == 0, "MmapIstream::Read should read data");
+    hr = mapped.ReadAt(12, buffer, 8, processed);
+    CHECK(hr == S_OK && processed == 4 && memcmp(buffer, "CDEF", 4) == 0, "MmapIstream::ReadAt should stop at the end");
+    hr = mapped.Seek(-2, SZ_SEEK_END, position);
+    CHECK(hr == S_OK && position == 14, "MmapIstream::Seek from end should return position");
+    hr = mapped.Read(buffer, 8, processed);
+    CHECK(hr == S_OK && processed == 2 && memcmp(buffer, "EF", 2) == 0, "MmapIstream::Read should stop at the end");
+    hr = mapped.Advise(0, 0, sevenzip::ADVICE_SEQUENTIAL);
+    CHECK(hr == S_OK || hr == S_FALSE, "MmapIstream::Advise should accept the sequential hint");
+    sevenzip::Istream* mappedClone = mapped.Clone();
+    mapped.Close();
+    hr = mappedClone->Read(buffer, 3, processed);
+    CHECK(hr == S_OK && processed == 3 && memcmp(buffer, "012", 3) == 0, "MmapIstream clone should read after the origin is closed");
+    delete mappedClone;
+
+    // FileIstream: missing file
+    sevenzip::FileIstream missing;
+    hr = missing.Open(L"test_file.missing");
+    CHECK(hr != S_OK, "FileIstream::Open should fail on a missing file");
+    hr = missing.Read(buffer, 4, processed);
+    CHECK(hr == E_FAIL, "FileIstream::Read should return E_FAIL when not opened");
+    hr = missing.ReadAt(0, buffer, 4, processed);
+    CHECK(hr == E_FAIL, "FileIstream::ReadAt should return E_FAIL when not opened");
+    CHECK(missing.GetSize(L"test_file.missing") == 0, "FileIstream::GetSize should return 0 on a missing file");
+    sevenzip::MmapIstream missingMapped;
+    hr = missingMapped.Open(L"test_file.missing");
+    CHECK(hr != S_OK && !missingMapped.IsMapped(), "MmapIstream::Open should fail on a missing file");
+
+    // BatchFileOstream: small item is queued with its time, large item is written directly
+    sevenzip::BatchFileOstream batch(nullptr, 2, 1, 8);
+    hr = batch.Open(L"test_batch_small.tmp");
+    CHECK(hr == S_OK, "BatchFileOstream::Open should start an item");
+    hr = batch.Write(data, 4, processed);
+    CHECK(hr == S_OK && processed == 4, "BatchFileOstream::Write should keep a small item");
+    batch.Close();
+    hr = batch.SetTime(L"test_batch_small.tmp", 1000000000);
+    CHECK(hr == S_OK, "BatchFileOstream::SetTime should be queued with the closed item");
+    hr = batch.Open(L"test_batch_large.tmp");
+    CHECK(hr == S_OK, "BatchFileOstream::Open should queue the previous item");
+    hr = batch.Write(data, 16, processed);
+    CHECK(hr == S_OK && processed == 16, "BatchFileOstream::Write should write a large item");
+    batch.Close();
+    hr = batch.Write(data, 4, processed);
+    CHECK(hr == E_FAIL, "BatchFileOstream::Write should return E_FAIL after Close");
+    hr = batch.SetMode(L"test_batch_small.tmp", 0600);
+    CHECK(hr == S_OK, "BatchFileOstream::SetMode should be set on the queued item");
+    hr = batch.Flush();
+    CHECK(hr == S_OK, "BatchFileOstream::Flush should write the queued items");
+    sevenzip::FileIstream check;
+    CHECK(check.GetSize(L"test_batch_small.tmp") == 4, "BatchFileOstream should write the small item");
+    CHECK(check.GetTime(L"test_batch_small.tmp") == 1000000000, "BatchFileOstream should set the time of the small item");
+    CHECK(check.GetSize(L"test_batch_large.tmp") == 16, "BatchFileOstream should write the large item");
+    std::remove("test_batch_small.tmp");
+    std::remove("test_batch_large.tmp");
+
+    // BatchFileOstream: the write error is kept with its path for Flush, the next item does not get it
+    FILE* blocker = fopen("test_batch_blocker.tmp", "w");
+    CHECK(blocker != nullptr, "test_batch_blocker.tmp should be created");
+    fclose(blocker);
+    hr = batch.Open(L"test_batch_blocker.tmp/item.tmp");
+    CHECK(hr == S_OK, "BatchFileOstream::Open should start an item under a file");
+    hr = batch.Write(data, 4, processed);
+    batch.Close();
+    hr = batch.Open(L"test_batch_next.tmp");
+    CHECK(hr == S_OK, "BatchFileOstream::Open should not return the error of another item");
+    batch.Close();
+    hr = batch.Flush();
+    CHECK(hr != S_OK, "BatchFileOstream::Flush should return the error of the failed item");
+    CHECK(wcscmp(batch.GetErrorPath(), L"test_batch_blocker.tmp/item.tmp") == 0, "BatchFileOstream::GetErrorPath should return the failed item");
+    CHECK(batch.Flush() == S_OK && batch.GetErrorPath()[0] == L'\0', "BatchFileOstream::Flush should return the error once");
+    std::remove("test_batch_next.tmp");
+    std::remove("test_batch_blocker.tmp");
+
+    // BatchFileOstream: the missing parents are created by the pool and through io_uring
+    for (int uring = 0; uring < 2; uring++) {
+        sevenzip::BatchFileOstream parents(L"test_batch_dir.tmp", 1, 0, 0, uring != 0);
+        CHECK(uring != 0 || !parents.IsUring(), "BatchFileOstream::IsUring should be false when not requested");
+        hr = parents.Open(L"a/b.tmp");
+        CHECK(hr == S_OK, "BatchFileOstream::Open should start an item under a missing parent");
+        hr = parents.Write(data, 4, processed);
+        parents.Close();
+        parents.SetTime(L"a/b.tmp", 1000000000);
+        hr = parents.Flush();
+        CHECK(hr == S_OK, "BatchFileOstream::Flush should create the missing parent");
+        CHECK(check.GetSize(L"test_batch_dir.tmp/a/b.tmp") == 4, "BatchFileOstream should write the item under the parent");
+        CHECK(check.GetTime(L"test_batch_dir.tmp/a/b.tmp") == 1000000000, "BatchFileOstream should set the time of the item under the parent");
+        std::remove("test_batch_dir.tmp/a/b.tmp");
+        std::remove("test_batch_dir.tmp/a");
+        std::remove("test_batch_dir.tmp");
+    }
+
+    // DirectoryOstream: parents are created under the base directory
+    sevenzip::DirectoryOstream dir(L"test_dir.tmp");
+    hr = dir.Mkdir(L"a");
+    CHECK(hr == S_OK, "DirectoryOstream::Mkdir should create the directory");
+    hr = dir.Open(L"a/b/c.tmp");
+    CHECK(hr == S_OK, "DirectoryOstream::Open should create the missing parents");
+    hr = dir.Write(data, 16, processed);
+    CHECK(hr == S_OK && processed == 16, "DirectoryOstream::Write should write all data");
+    dir.Close();
+    hr = dir.SetTime(L"a/b/c.tmp", 1000000000);
+    CHECK(hr == S_OK, "DirectoryOstream::SetTime should set the time");
+    hr = dir.Open(L"a/b/d.tmp");
+    CHECK(hr == S_OK, "DirectoryOstream::Open should reuse the parent");
+    dir.Close();
+    CHECK(check.GetSize(L"test_dir.tmp/a/b/c.tmp") == 16, "DirectoryOstream should write the file");
+    CHECK(check.GetTime(L"test_dir.tmp/a/b/c.tmp") == 1000000000, "DirectoryOstream should set the time of the file");
+    CHECK(check.IsDir(L"test_dir.tmp/a/b"), "DirectoryOstream should create the parent directory");
+    std::remove("test_dir.tmp/a/b/c.tmp");
+    std::remove("test_dir.tmp/a/b/d.tmp");
+    std::remove("test_dir.tmp/a/b");
+    std::remove("test_dir.tmp/a");
+    std::remove("test_dir.tmp");
+
+    std::remove("test_file.tmp");
+
+    std::cout << "file tests passed." << std::endl;
+}
@@ -40,6 +40,27 @@ struct FakeOstream : public sevenzip::Ostream {
     virtual void Close() override {}
 };
 
+// Creates one FakeOstream for every item
+struct FakeFactory : public sevenzip::OstreamFactory {
+    int creates = 0;
+    virtual sevenzip::Ostream* Create(int /*index*/, const sevenzip::ItemInfo& /*info*/) override {
+        ++creates;
+        return new FakeOstream();
+    }
+    virtual void Release(int /*index*/, sevenzip::Ostream* ostream, HRESULT /*result*/) override {
+        delete ostream;
+    }
+};
+
+// Selects every item
+struct AllSelector : public sevenzip::Iselector {
+    int calls = 0;
+    virtual bool Select(int /*index*/) override {
+        ++calls;
+        return true;
+    }
+};
+
 void run_iarchive_tests() {
     std::cout << "Running archive tests... ";
 
@@ -47,6 +68,11 @@ void run_iarchive_tests() {
     FakeIstream in;
     sevenzip::Lib l; // not loaded
 
+    // Istream: positional reads are not implemented by default
+    UInt32 processed = 0;
+    char byte = 0;
+    CHECK(in.ReadAt(0, &byte, 1, processed) == E_NOTIMPL, "Istream::ReadAt should return E_NOTIMPL by default");
+
     // Iarchive: passing nullptr istream should return S_FALSE
     sevenzip::Iarchive iarc;
     hr = iarc.open(l, in, L"file.7z");
@@ -64,6 +90,90 @@ void run_iarchive_tests() {
     goodStream.seek_ok = true;
     hr = iarc.open(l, goodStream, L"file.7z");
     CHECK(hr == S_FALSE, "Iarchive::open should return S_FALSE when library CreateObjectFunc is not available");
+    hr = iarc.open(l, goodStream, L"file.7z", nullptr, -1, 512);
+    CHECK(hr == S_FALSE, "Iarchive::open at offset should return S_FALSE when library CreateObjectFunc is not available");
+
+    // Iarchive: batch extraction from unopened archive -> E_FAIL
+    FakeOstream out;
+    const UInt32 indices[] = {3, 1, 3};
+    hr = iarc.extract(out, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract with indices should return E_FAIL when archive is not opened");
+    sevenzip::Ostream* outs[2] = {&out, &out};
+    hr = iarc.extract(outs, 2, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract parallel should return E_FAIL when archive is not opened");
+    FakeFactory factory;
+    hr = iarc.extract(factory, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract with factory should return E_FAIL when archive is not opened");
+    hr = iarc.extract(factory, 2, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract parallel with factory should return E_FAIL when archive is not opened");
+    CHECK(factory.creates == 0, "Iarchive::extract should not create streams when archive is not opened");
+    AllSelector selector;
+    hr = iarc.extract(out, selector);
+    CHECK(hr == E_FAIL, "Iarchive::extract with selector should return E_FAIL when archive is not opened");
+    CHECK(selector.calls == 0, "Iarchive::extract should not call selector when archive is not opened");
+
+    // Iarchive: item reader of unopened archive -> E_FAIL
+    sevenzip::Istream* item = &in;
+    hr = iarc.openItem(0, item);
+    CHECK(hr == E_FAIL && item == nullptr, "Iarchive::openItem should return E_FAIL when archive is not opened");
+
+    // Iarchive: snapshot of unopened archive -> E_FAIL
+    sevenzip::ItemInfo info;
+    CHECK(iarc.snapshot() == E_FAIL, "Iarchive::snapshot should return E_FAIL when archive is not opened");
+    CHECK(iarc.getItemInfo(0, info) == E_FAIL, "Iarchive::getItemInfo should return E_FAIL when archive is not opened");
+
+    // Iarchive: block map of unopened archive -> E_FAIL
+    sevenzip::BlockInfo block;
+    sevenzip::ExtractPlan plan;
+    CHECK(iarc.getNumberOfBlocks() == 0, "Iarchive::getNumberOfBlocks should return 0 when archive is not opened");
+    CHECK(iarc.getBlockInfo(0, block) == E_FAIL, "Iarchive::getBlockInfo should return E_FAIL when archive is not opened");
+    CHECK(iarc.planExtract(indices, 3, plan) == E_FAIL, "Iarchive::planExtract should return E_FAIL when archive is not opened");
+
+    // Iarchive: no stream activity without an archive
+    sevenzip::Stats stats;
+    iarc.getStats(stats);
+    CHECK(stats.reads == 0 && stats.seeks == 0 && stats.seeksElided == 0, "Iarchive::getStats should be empty when archive is not opened");
+    iarc.resetStats();
+
+    // Iarchive: read-ahead is applied on open, the stream is not touched before
+    sevenzip::Iarchive ahead;
+    ahead.setReadAhead(4, 1 << 16);
+    hr = ahead.open(l, goodStream, L"file.7z");
+    CHECK(hr == S_FALSE, "Iarchive::open with read-ahead should return S_FALSE when library CreateObjectFunc is not available");
+    ahead.getStats(stats);
+    CHECK(stats.readAheadHits == 0 && stats.readAheadMisses == 0, "Iarchive::getStats should have no read-ahead reads when archive is not opened");
+
+    // Iarchive: decoder properties are kept for the next open
+    CHECK(ahead.setIntProperty(L"mt", 4) == S_OK, "Iarchive::setIntProperty should keep the property before open");
+    CHECK(ahead.setIntProperty(L"mt", 2) == S_OK, "Iarchive::setIntProperty should replace the property");
+    CHECK(ahead.setWideProperty(L"memuse", (UInt64)1 << 30) == S_OK, "Iarchive::setWideProperty should keep the property before open");
+    CHECK(ahead.setIntProperty(nullptr, 1) == S_FALSE, "Iarchive::setIntProperty should return S_FALSE without a name");
+    hr = ahead.open(l, goodStream, L"file.tar.xz");
+    CHECK(hr == S_FALSE, "Iarchive::open with properties should return S_FALSE when library CreateObjectFunc is not available");
+
+    // Iarchive: write-behind is used by extract only
+    ahead.setWriteBehind(2, 1 << 16);
+    hr = ahead.extract(out, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract with write-behind should return E_FAIL when archive is not opened");
+
+    // Iarchive: deferred metadata is used by extract only
+    ahead.setDeferredMetadata(4);
+    hr = ahead.extract(out, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract with deferred metadata should return E_FAIL when archive is not opened");
+    hr = ahead.extract(out);
+    CHECK(hr == E_FAIL, "Iarchive::extract all with deferred metadata should return E_FAIL when archive is not opened");
+
+    // Iarchive: skip-if-unchanged is used by extract only
+    ahead.setSkipUnchanged(sevenzip::SKIP_CRC, 2);
+    hr = ahead.extract(out, indices, 3);
+    CHECK(hr == E_FAIL, "Iarchive::extract with skip-if-unchanged should return E_FAIL when archive is not opened");
+    UInt32 changed[3];
+    UInt32 numChanged = 1;
+    hr = ahead.findChanged(out, indices, 3, changed, numChanged);
+    CHECK(hr == E_FAIL && numChanged == 0, "Iarchive::findChanged should return E_FAIL when archive is not opened");
+    UInt64 statSize = 0;
+    UInt32 statTime = 0;
+    CHECK(out.Stat(L"file", statSize, statTime) == E_NOTIMPL, "Ostream::Stat should return E_NOTIMPL by default");
 
     std::cout << "iarchive tests passed." << std::endl;
 }
@@ -43,6 +43,21 @@ void run_lib_tests() {
     CHECK(l.getNumberOfFormats() == 0, "Lib::getNumberOfFormats should be 0 when library not loaded");
     CHECK(l.getFormatByExtension(L"7z") == -1, "Lib::getFormatByExtension should return -1 when no formats available");
     CHECK(l.getFormatBySignature(in) == -1, "Lib::getFormatBySignature should return -1 when no formats available");
+    int formats[4] = {-1, -1, -1, -1};
+    CHECK(l.getFormatsBySignature(in, formats, 4) == 0, "Lib::getFormatsBySignature should return 0 when no formats available");
+    CHECK(formats[0] == -1, "Lib::getFormatsBySignature should not store indices when no formats available");
+    sevenzip::EmbeddedArchive archives[2] = {{0, -1}, {0, -1}};
+    CHECK(l.findEmbeddedArchives(in, archives, 2) == 0, "Lib::findEmbeddedArchives should return 0 when no formats available");
+    CHECK(l.getFormatName(0)[0] == L'\0', "Lib::getFormatName should return empty string when no formats available");
+    CHECK(!l.getFormatUpdatable(0), "Lib::getFormatUpdatable should return false when no formats available");
+
+    // Number of threads: detected unless set for the process
+    int detected = sevenzip::getNumberOfThreads();
+    CHECK(detected >= 1, "getNumberOfThreads should return at least 1");
+    sevenzip::setNumberOfThreads(3);
+    CHECK(sevenzip::getNumberOfThreads() == 3, "setNumberOfThreads should override the detected number");
+    sevenzip::setNumberOfThreads(0);
+    CHECK(sevenzip::getNumberOfThreads() == detected, "setNumberOfThreads(0) should restore the detected number");
 
     std::cout << "lib tests passed." << std::endl;
 }
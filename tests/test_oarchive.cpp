@@ -65,5 +65,10 @@ void run_oarchive_tests() {
     hr = oarc.open(l, in, goodO, L"out.7z");
     CHECK(hr == S_FALSE, "Oarchive::open should return S_FALSE when library CreateObjectFunc missing");
 
+    // Oarchive: no stream activity without an archive
+    sevenzip::Stats stats;
+    oarc.getStats(stats);
+    CHECK(stats.writes == 0 && stats.seeks == 0 && stats.seeksElided == 0, "Oarchive::getStats should be empty when archive is not opened");
+
     std::cout << "oarchive tests passed." << std::endl;
 }
@@ -3,6 +3,8 @@
 void run_lib_tests();
 void run_iarchive_tests();
 void run_oarchive_tests();
+void run_file_tests();
+void run_codec_tests();
 
 int main() {
     setlocale(LC_ALL, "");
@@ -25,6 +27,18 @@ int main() {
         std::cerr << "Exception in oarchive tests: " << e.what() << std::endl;
         ++failures;
     }
+    try {
+        run_file_tests();
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in file tests: " << e.what() << std::endl;
+        ++failures;
+    }
+    try {
+        run_codec_tests();
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in codec tests: " << e.what() << std::endl;
+        ++failures;
+    }
 
     if (failures) {
         std::cerr << failures << " test group(s) failed." << std::endl;